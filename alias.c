@@ -0,0 +1,303 @@
+//
+//  alias.c
+//  Shell
+//
+//  Aliases kept in a trie and spliced into commands before they are dispatched.
+//
+
+#include "smallshell.h"
+
+AliasNode *Aliases = NULL; // First node of the trie
+int AliasCount = 0;
+
+// Function finds the node for a name, creating the path to it when create is set
+static AliasNode *alias_node(char *name, int create)
+{
+    AliasNode **level = &Aliases;
+    AliasNode *node = NULL;
+
+    for (; *name != '\0'; name++)
+    {
+        // Siblings are kept in order so listing is alphabetical
+        while (*level != NULL && (*level)->key < *name)
+        {
+            level = &(*level)->sibling;
+        }
+
+        if (*level == NULL || (*level)->key != *name)
+        {
+            if (!create)
+                return NULL;
+
+            node = calloc(1, sizeof(AliasNode));
+            if (!node)
+            {
+                fprintf(stderr, "Shell Allocation Error\n");
+                exit(EXIT_FAILURE);
+            }
+
+            node->key = *name;
+            node->sibling = *level;
+            *level = node;
+        }
+
+        node = *level;
+        level = &node->child;
+    }
+
+    return node;
+}
+
+// Function finds the words of an alias
+List *find_alias(char *name)
+{
+    if (AliasCount == 0)
+        return NULL;
+
+    AliasNode *node = alias_node(name, 0);
+
+    return node ? node->value : NULL;
+}
+
+// Function defines or replaces an alias, the words are copied into a list of their own
+void define_alias(char *name, char **words, int size)
+{
+    AliasNode *node = alias_node(name, 1);
+    List *value = createListSized(1, size + 1, 0);
+
+    for (int i = 0; i < size; i++)
+    {
+        listAppendToken(value, words[i], 0, (int)strlen(words[i]));
+    }
+    listEndCommand(value, '\0');
+    listResolve(value);
+
+    if (node->value != NULL)
+        destroyList(node->value);
+    else
+        AliasCount++;
+
+    node->value = value;
+}
+
+// Function removes an alias, the trie keeps its nodes for the next definition
+int remove_alias(char *name)
+{
+    AliasNode *node = alias_node(name, 0);
+
+    if (node == NULL || node->value == NULL)
+        return 0;
+
+    destroyList(node->value);
+    node->value = NULL;
+    AliasCount--;
+
+    return 1;
+}
+
+// Function prints every alias below a node, prefix holds the name so far
+static void print_aliases(AliasNode *node, char *prefix, int length)
+{
+    for (; node != NULL; node = node->sibling)
+    {
+        prefix[length] = node->key;
+        prefix[length + 1] = '\0';
+
+        if (node->value != NULL)
+        {
+            printf("alias %s=", prefix);
+            for (int i = 0; i < node->value->container[0].size; i++)
+            {
+                printf(i == 0 ? "%s" : " %s", node->value->container[0].line[i]);
+            }
+            printf("\n");
+        }
+
+        print_aliases(node->child, prefix, length + 1);
+    }
+}
+
+// Function frees a trie
+static void free_aliases(AliasNode *node)
+{
+    while (node != NULL)
+    {
+        AliasNode *sibling = node->sibling;
+
+        free_aliases(node->child);
+        destroyList(node->value);
+        free(node);
+        node = sibling;
+    }
+}
+
+// Function appends a word to a list, replacing it with its alias
+// Names already in the chain are left alone so aliases can't loop, and the chain is bounded
+static void splice_alias(List *dst, char *word, char **chain, int depth)
+{
+    List *value = depth < SHELL_ALIAS_DEPTH ? find_alias(word) : NULL;
+
+    for (int i = 0; i < depth && value != NULL; i++)
+    {
+        if (strcmp(chain[i], word) == 0)
+            value = NULL;
+    }
+
+    if (value == NULL || value->container[0].size == 0)
+    {
+        listAppendToken(dst, word, 0, (int)strlen(word));
+        return;
+    }
+
+    chain[depth] = word;
+    splice_alias(dst, value->container[0].line[0], chain, depth + 1);
+
+    for (int i = 1; i < value->container[0].size; i++)
+    {
+        listAppendToken(dst, value->container[0].line[i], 0, (int)strlen(value->container[0].line[i]));
+    }
+}
+
+// Function checks if a command of a list names a program rather than a redirection file
+static int is_command_node(List *cmd, int i)
+{
+    return i == 0 || (cmd->container[i - 1].ops != '<' && cmd->container[i - 1].ops != '>');
+}
+
+// Function replaces the first word of every command with its alias, splicing the words into dst
+// Lists without aliases are returned as they are
+List *expand_aliases(List *cmd, List *dst)
+{
+    char *chain[SHELL_ALIAS_DEPTH];
+    int found = 0;
+
+    if (AliasCount == 0)
+        return cmd;
+
+    for (int i = 0; i < cmd->count && !found; i++)
+    {
+        found = is_command_node(cmd, i) && find_alias(cmd->container[i].line[0]) != NULL;
+    }
+
+    if (!found)
+        return cmd;
+
+    listReset(dst);
+    for (int i = 0; i < cmd->count; i++)
+    {
+        char **line = cmd->container[i].line;
+        // The rest of the words are copied over as they are
+        if (is_command_node(cmd, i))
+            splice_alias(dst, line[0], chain, 0);
+        else
+            listAppendToken(dst, line[0], 0, (int)strlen(line[0]));
+
+        for (int j = 1; j < cmd->container[i].size; j++)
+        {
+            listAppendToken(dst, line[j], 0, (int)strlen(line[j]));
+        }
+
+        listEndCommand(dst, cmd->container[i].ops);
+    }
+    listResolve(dst);
+
+    return dst;
+}
+
+// Function defines or shows aliases
+// alias NAME=words, alias NAME, alias
+int shell_alias(char **args, int size, int status)
+{
+    // List every alias
+    if (size == 1)
+    {
+        char prefix[SHELL_ALIAS_NAME_MAX];
+
+        print_aliases(Aliases, prefix, 0);
+        return 1;
+    }
+
+    char *equals = strchr(args[1], '=');
+    // Show a single alias
+    if (equals == NULL)
+    {
+        List *value = find_alias(args[1]);
+
+        if (value == NULL)
+        {
+            fprintf(stderr, "alias: %s: not found\n", args[1]);
+            LastStatus = W_EXITCODE(1, 0);
+            return 1;
+        }
+
+        printf("alias %s=", args[1]);
+        for (int i = 0; i < value->container[0].size; i++)
+        {
+            printf(i == 0 ? "%s" : " %s", value->container[0].line[i]);
+        }
+        printf("\n");
+        return 1;
+    }
+
+    if (equals == args[1] || equals - args[1] >= SHELL_ALIAS_NAME_MAX - 1)
+    {
+        fprintf(stderr, "alias: %s: invalid alias name\n", args[1]);
+        LastStatus = W_EXITCODE(1, 0);
+        return 1;
+    }
+    // The words are what follows the = and every arg after it
+    char *name = args[1];
+    int skip = equals[1] == '\0' ? 2 : 1;
+
+    if (size - skip == 0)
+    {
+        fprintf(stderr, "alias: %s: empty alias\n", args[1]);
+        LastStatus = W_EXITCODE(1, 0);
+        return 1;
+    }
+
+    *equals = '\0';
+    args[1] = equals + 1;
+    define_alias(name, args + skip, size - skip);
+    args[1] = name;
+    *equals = '=';
+
+    return 1;
+}
+
+// Function removes aliases
+// unalias NAME..., unalias -a
+int shell_unalias(char **args, int size, int status)
+{
+    if (size == 1)
+    {
+        fprintf(stderr, "usage: unalias [-a] NAME...\n");
+        LastStatus = W_EXITCODE(1, 0);
+        return 1;
+    }
+
+    if (strcmp(args[1], "-a") == 0)
+    {
+        destroy_aliases();
+        return 1;
+    }
+
+    for (int i = 1; i < size; i++)
+    {
+        if (!remove_alias(args[i]))
+        {
+            fprintf(stderr, "unalias: %s: not found\n", args[i]);
+            LastStatus = W_EXITCODE(1, 0);
+        }
+    }
+
+    return 1;
+}
+
+// Function frees every alias
+void destroy_aliases(void)
+{
+    free_aliases(Aliases);
+    Aliases = NULL;
+    AliasCount = 0;
+}
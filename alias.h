@@ -0,0 +1,38 @@
+//
+//  alias.h
+//  Shell
+//
+//  Aliases kept in a trie and spliced into commands before they are dispatched.
+//
+
+#ifndef alias_h
+#define alias_h
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lexer.h"
+
+#define SHELL_ALIAS_DEPTH 16
+#define SHELL_ALIAS_NAME_MAX 256
+
+// One character of an alias name, the words are set on the node that ends a name
+typedef struct AliasNode
+{
+    char key;
+    struct AliasNode *child;   // Nodes for the next character
+    struct AliasNode *sibling; // Other nodes for this character, in order
+    List *value;
+} AliasNode;
+
+int shell_alias(char **, int, int);
+int shell_unalias(char **, int, int);
+
+List *find_alias(char *);
+void define_alias(char *, char **, int);
+int remove_alias(char *);
+List *expand_aliases(List *, List *);
+void destroy_aliases(void);
+
+#endif /* alias_h */
@@ -0,0 +1,479 @@
+//
+//  check.c
+//  Shell
+//
+//  Checks that a reused list stops growing once it has seen the largest line, that
+//  running builtin only commands doesn't allocate once warm and that the snapshot
+//  loader round trips programs and rejects broken snapshots. Built with make check.
+//
+
+#include "smallshell.h"
+
+#define CHECK_ITERATIONS 1000000
+#define CHECK_WARMUP 1000
+
+// Provided by AddressSanitizer, make check always builds with it
+size_t __sanitizer_get_current_allocated_bytes(void);
+
+static char *lines[] = {
+    "ls -la",
+    "echo hello world > out.txt && cat < out.txt | wc -l",
+    "# only a comment",
+    "",
+    "sleep 1 &",
+    "a=1; b=2; echo $a $b; false || true",
+    "cd /tmp && ls; pwd; echo done # trailing comment",
+    "for i in one two three four five six seven eight nine ten; do echo $i; done",
+};
+
+static char *script[] = {
+    "function greet",
+    "for name in $@",
+    "echo hello $name",
+    "done",
+    "end",
+    "x=1",
+    "while false",
+    "break",
+    "done",
+    "if true",
+    "greet a b",
+    "else",
+    "echo no",
+    "fi",
+};
+
+// Commands run the way the prompt runs them, none of them start a process
+static char *commands[] = {
+    "x=$y",
+    "call",
+    "f a b",
+    "cd .",
+    "y=$x$$",
+};
+
+// Block compiled and released every time it runs, like the prompt does for control flow
+static char *block[] = {
+    "for i in a b $y",
+    "f $i",
+    "done",
+};
+
+// Hand built snapshot payload
+typedef struct
+{
+    char data[1024];
+    size_t size;
+} Payload;
+
+int failures = 0;
+
+// Function reports a failed check
+static void fail(char *what)
+{
+    fprintf(stderr, "check: %s\n", what);
+    failures++;
+}
+
+// Function checks that parsing into one list stops allocating after the first pass
+static void check_list_reuse(void)
+{
+    int count = sizeof(lines) / sizeof(lines[0]);
+    List *list = createList();
+    int size = 0, argv_size = 0, buffer_size = 0;
+    // One pass over every line sizes the buffers for all of them
+    for (int i = 0; i < count; i++)
+    {
+        parse_input_into(list, lines[i]);
+    }
+
+    size = list->size;
+    argv_size = list->argv_size;
+    buffer_size = list->buffer_size;
+
+    for (int i = 0; i < CHECK_ITERATIONS; i++)
+    {
+        parse_input_into(list, lines[i % count]);
+
+        if (list->size != size || list->argv_size != argv_size || list->buffer_size != buffer_size)
+        {
+            fprintf(stderr, "check: list grew on iteration %d (%d/%d/%d -> %d/%d/%d)\n", i,
+                    size, argv_size, buffer_size, list->size, list->argv_size, list->buffer_size);
+            failures++;
+            break;
+        }
+    }
+
+    destroyList(list);
+    printf("check: %d parses, list stayed at %d/%d/%d\n", CHECK_ITERATIONS, size, argv_size, buffer_size);
+}
+
+// Function compiles and runs script lines the way shell_run_block does once it has read them
+static void run_lines(char **text, int count, Processes *proc)
+{
+    Program *prog = compile_script(text, count);
+
+    if (prog == NULL)
+    {
+        fail("script didn't compile");
+        return;
+    }
+
+    run_program(prog, proc);
+    release_program(prog);
+}
+
+// Function checks that the command path keeps the same memory across a million commands
+// Aliases, variables and function calls go through the frame lists, blocks are compiled and released
+static void check_command_memory(void)
+{
+    char *setup[] = {"function f", "x=$1", "end"};
+    char *alias_line = "alias call=f one two";
+    int count = sizeof(commands) / sizeof(commands[0]);
+    List *args = createList();
+    Processes *proc = create_processes();
+    size_t allocated = 0;
+
+    run_lines(setup, sizeof(setup) / sizeof(setup[0]), proc);
+    run_command(shell_split_line(args, alias_line), proc);
+    // Every command and the block get their buffers before memory is measured
+    for (int i = 0; i < CHECK_ITERATIONS + CHECK_WARMUP; i++)
+    {
+        if (i == CHECK_WARMUP)
+            allocated = __sanitizer_get_current_allocated_bytes();
+
+        if (i % (count + 2) < count)
+        {
+            run_command(shell_split_line(args, commands[i % (count + 2)]), proc);
+        }
+        else if (i % (count + 2) == count)
+        {
+            shell_run_block("x=$y", proc);
+        }
+        else
+        {
+            run_lines(block, sizeof(block) / sizeof(block[0]), proc);
+        }
+
+        if (LastStatus != 0)
+        {
+            fprintf(stderr, "check: command %d failed\n", i);
+            failures++;
+            break;
+        }
+    }
+
+    size_t after = __sanitizer_get_current_allocated_bytes();
+
+    if (after > allocated)
+    {
+        fprintf(stderr, "check: command path grew from %zu to %zu bytes\n", allocated, after);
+        failures++;
+    }
+
+    destroyList(args);
+    destroy_proccess(proc);
+    destroy_functions();
+    destroy_aliases();
+    printf("check: %d commands, %zu bytes allocated before and %zu after\n", CHECK_ITERATIONS, allocated, after);
+}
+
+// Function checks that every command a program keeps is sized exactly for its words
+static int program_is_compact(Program *prog)
+{
+    for (int i = 0; i < prog->command_count; i++)
+    {
+        List *cmd = prog->commands[i];
+
+        if (cmd->size != cmd->count || cmd->argv_size != cmd->argc || cmd->buffer_size != cmd->buffer_length)
+            return 0;
+    }
+
+    for (int i = 0; i < prog->body_count; i++)
+    {
+        if (!program_is_compact(prog->bodies[i]))
+            return 0;
+    }
+
+    return 1;
+}
+
+// Function appends a 32 bit integer to a payload
+static void put_int(Payload *p, int32_t value)
+{
+    memcpy(p->data + p->size, &value, sizeof(value));
+    p->size += sizeof(value);
+}
+
+// Function appends bytes to a payload
+static void put_bytes(Payload *p, const void *bytes, size_t size)
+{
+    memcpy(p->data + p->size, bytes, size);
+    p->size += size;
+}
+
+// Function appends a program header, name_length -1 is the unnamed rc program
+static void put_program(Payload *p, char *name, int name_length, int count, int loops, int commands, int bodies)
+{
+    put_int(p, name_length);
+    if (name_length > 0)
+        put_bytes(p, name, name_length);
+    put_int(p, count);
+    put_int(p, loops);
+    put_int(p, commands);
+    put_int(p, bodies);
+}
+
+// Function appends an instruction
+static void put_instruction(Payload *p, int op, int arg, int target)
+{
+    Instruction in = {op, arg, target};
+
+    put_bytes(p, &in, sizeof(in));
+}
+
+// Function appends a single command of words
+static void put_command(Payload *p, char **words, int size)
+{
+    int length = 0;
+
+    put_int(p, size > 0 ? 1 : 0);
+    put_int(p, size > 0 ? size + 1 : 0);
+    for (int i = 0; i < size; i++)
+    {
+        length += strlen(words[i]) + 1;
+    }
+    put_int(p, length);
+
+    if (size == 0)
+        return;
+    // One node with every word, then the offsets and the terminator
+    put_int(p, 0);
+    put_int(p, size);
+    put_int(p, 0);
+
+    for (int i = 0, offset = 0; i < size; i++)
+    {
+        put_int(p, offset);
+        offset += strlen(words[i]) + 1;
+    }
+    put_int(p, -1);
+
+    for (int i = 0; i < size; i++)
+    {
+        put_bytes(p, words[i], strlen(words[i]) + 1);
+    }
+}
+
+// Function writes a snapshot of a payload for the rc file, with a valid header
+static void write_snapshot(char *path, struct stat *rc, const void *payload, size_t size)
+{
+    SnapshotHeader header;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SHELL_SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SHELL_SNAPSHOT_VERSION;
+    header.instruction_size = sizeof(Instruction);
+    header.rc_mtime_sec = rc->st_mtim.tv_sec;
+    header.rc_mtime_nsec = rc->st_mtim.tv_nsec;
+    header.rc_size = rc->st_size;
+    header.rc_inode = rc->st_ino;
+    header.payload_size = size;
+    header.payload_hash = snapshot_hash(payload, size);
+
+    FILE *out = fopen(path, "wb");
+
+    fwrite(&header, sizeof(header), 1, out);
+    fwrite(payload, 1, size, out);
+    fclose(out);
+}
+
+// Function reads a whole file
+static char *read_file(char *path, size_t *size)
+{
+    FILE *in = fopen(path, "rb");
+    char *data = NULL;
+
+    *size = 0;
+    if (in == NULL)
+        return NULL;
+
+    ssize_t length = getdelim(&data, size, EOF, in);
+
+    fclose(in);
+    *size = length < 0 ? 0 : length;
+
+    return data;
+}
+
+// Function checks whether a payload loads, releasing the program
+static int payload_loads(char *path, struct stat *rc, Payload *p)
+{
+    write_snapshot(path, rc, p->data, p->size);
+
+    Program *prog = load_snapshot(path, rc);
+
+    if (prog)
+        release_program(prog);
+
+    return prog != NULL;
+}
+
+// Function checks that for loops and function bodies are only accepted when they can run
+static void check_snapshot_programs(char *path, struct stat *rc)
+{
+    char *for_words[] = {"i", "in", "a"};
+    Payload p;
+    // for i in a with its loop counted
+    p.size = 0;
+    put_program(&p, NULL, -1, 2, 1, 1, 0);
+    put_instruction(&p, OP_FOR_INIT, 0, 0);
+    put_instruction(&p, OP_FOR_NEXT, 0, 2);
+    put_command(&p, for_words, 3);
+    if (!payload_loads(path, rc, &p))
+        fail("valid for loop was rejected");
+    // The same loop without its loop count
+    p.size = 0;
+    put_program(&p, NULL, -1, 2, 0, 1, 0);
+    put_instruction(&p, OP_FOR_INIT, 0, 0);
+    put_instruction(&p, OP_FOR_NEXT, 0, 2);
+    put_command(&p, for_words, 3);
+    if (payload_loads(path, rc, &p))
+        fail("for loop without a loop count was loaded");
+    // A loop over an empty command and over a command without words
+    for (int size = 0; size < 2; size++)
+    {
+        p.size = 0;
+        put_program(&p, NULL, -1, 2, 1, 1, 0);
+        put_instruction(&p, OP_FOR_INIT, 0, 0);
+        put_instruction(&p, OP_FOR_NEXT, 0, 2);
+        put_command(&p, for_words, size);
+        if (payload_loads(path, rc, &p))
+            fail("for loop without NAME in words was loaded");
+    }
+    // OP_FOR_NEXT before its OP_FOR_INIT
+    p.size = 0;
+    put_program(&p, NULL, -1, 2, 1, 1, 0);
+    put_instruction(&p, OP_FOR_NEXT, 0, 2);
+    put_instruction(&p, OP_FOR_INIT, 0, 0);
+    put_command(&p, for_words, 3);
+    if (payload_loads(path, rc, &p))
+        fail("for loop entered before its init was loaded");
+    // A function body must have a name
+    for (int named = 1; named >= 0; named--)
+    {
+        p.size = 0;
+        put_program(&p, NULL, -1, 1, 0, 0, 1);
+        put_instruction(&p, OP_DEFINE, 0, 0);
+        put_program(&p, "f", named ? 1 : -1, 0, 0, 0, 0);
+        if (payload_loads(path, rc, &p) != named)
+            fail(named ? "named function body was rejected" : "unnamed function body was loaded");
+    }
+}
+
+// Function checks that a compiled script survives a snapshot and that broken snapshots are rejected
+static void check_snapshot(void)
+{
+    char rc_file[] = "/tmp/smallsh-check-XXXXXX";
+    int fd = mkstemp(rc_file);
+    struct stat rc;
+
+    if (fd == -1)
+    {
+        fail("can't create the rc file");
+        return;
+    }
+
+    write(fd, "x=1\n", 4);
+    close(fd);
+    stat(rc_file, &rc);
+
+    char path[64], copy[64];
+    size_t size = 0, copy_size = 0;
+
+    snprintf(path, sizeof(path), "%s.snapshot", rc_file);
+    snprintf(copy, sizeof(copy), "%s.copy", rc_file);
+    // A loaded program saves to the same bytes it was loaded from
+    Program *prog = compile_script(script, sizeof(script) / sizeof(script[0]));
+    Program *loaded = NULL;
+
+    if (!prog || !save_snapshot(path, &rc, prog) || !(loaded = load_snapshot(path, &rc)) || !save_snapshot(copy, &rc, loaded))
+        fail("snapshot round trip failed");
+    if (prog && !program_is_compact(prog))
+        fail("compiled commands aren't sized exactly");
+
+    char *data = read_file(path, &size);
+    char *copy_data = read_file(copy, &copy_size);
+
+    if (!data || size != copy_size || memcmp(data, copy_data, size) != 0)
+        fail("reloaded snapshot differs from the original");
+
+    if (prog)
+        release_program(prog);
+    if (loaded)
+        release_program(loaded);
+    free(copy_data);
+    // Truncated snapshots and ones with a changed byte fail the header checks
+    if (data)
+    {
+        char *payload = data + sizeof(SnapshotHeader);
+        size_t payload_size = size - sizeof(SnapshotHeader);
+        FILE *out = fopen(path, "wb");
+
+        fwrite(data, 1, size / 2, out);
+        fclose(out);
+        if ((loaded = load_snapshot(path, &rc)) != NULL)
+        {
+            fail("truncated snapshot was loaded");
+            release_program(loaded);
+        }
+
+        payload[payload_size / 2] ^= 0x40;
+        out = fopen(path, "wb");
+        fwrite(data, 1, size, out);
+        fclose(out);
+        if ((loaded = load_snapshot(path, &rc)) != NULL)
+        {
+            fail("corrupt snapshot was loaded");
+            release_program(loaded);
+        }
+        payload[payload_size / 2] ^= 0x40;
+        // With a matching hash every cut must still be rejected by the reader
+        for (size_t cut = 0; cut < payload_size; cut++)
+        {
+            write_snapshot(path, &rc, payload, cut);
+            if ((loaded = load_snapshot(path, &rc)) != NULL)
+            {
+                fail("truncated payload was loaded");
+                release_program(loaded);
+            }
+        }
+        // Any changed byte must either load or be rejected without reading out of bounds
+        for (size_t i = 0; i < payload_size; i++)
+        {
+            payload[i] ^= 0xff;
+            write_snapshot(path, &rc, payload, payload_size);
+            if ((loaded = load_snapshot(path, &rc)) != NULL)
+                release_program(loaded);
+            payload[i] ^= 0xff;
+        }
+    }
+
+    check_snapshot_programs(path, &rc);
+
+    free(data);
+    unlink(path);
+    unlink(copy);
+    unlink(rc_file);
+    printf("check: snapshot loader\n");
+}
+
+int main(void)
+{
+    check_list_reuse();
+    check_command_memory();
+    check_snapshot();
+    destroy_functions();
+
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
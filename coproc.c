@@ -0,0 +1,459 @@
+//
+//  coproc.c
+//  Shell
+//
+//  Named pools of persistent helper processes that answer one line per request.
+//  A request waits SHELL_COPROC_TIMEOUT_MS for its line so a helper that buffers
+//  its output fails the send instead of hanging the shell.
+//
+
+#include "smallshell.h"
+
+HelperPools Pools = {NULL, 0, 0};
+
+// Function finds a pool by name
+HelperPool *find_pool(char *name)
+{
+    for (int i = 0; i < Pools.count; i++)
+    {
+        if (strcmp(Pools.pool[i].name, name) == 0)
+        {
+            return &Pools.pool[i];
+        }
+    }
+
+    return NULL;
+}
+
+// Function starts a single helper connected to the shell through a socket pair
+// A socket is used over two pipes so writes to a dead helper fail instead of raising SIGPIPE
+static int start_helper(Helper *helper, char **command)
+{
+    int fds[2];
+
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) == -1)
+    {
+        perror("coproc");
+        return 0;
+    }
+
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0)
+    { // Child Process
+        // The helper reads requests from stdin and writes responses to stdout
+        dup2(fds[1], 0);
+        dup2(fds[1], 1);
+        // Kill this process code and have the program run with this process id
+        if (execvp(command[0], command) == -1)
+        {
+            fprintf(stderr, "%s: no such file or directory\n", command[0]);
+        }
+        // If code reaches here there was a problem
+        exit(EXIT_FAILURE);
+    }
+    else if (pid < 0)
+    { // Error in fork process
+        perror("Shell: Error starting helper process through fork");
+        close(fds[0]);
+        close(fds[1]);
+        return 0;
+    }
+    // Parent process keeps its end only
+    close(fds[1]);
+    helper->pid = pid;
+    helper->fd = fds[0];
+    helper->input = NULL;
+    helper->length = 0;
+    helper->size = 0;
+    helper->stale = 0;
+
+    return 1;
+}
+
+// Function waits up to ms milliseconds for a helper to exit, returns 1 once it's reaped
+static int reap_helper(pid_t pid, int ms)
+{
+    struct timespec step = {0, 10 * 1000000L};
+
+    for (int waited = 0;; waited += 10)
+    {
+        pid_t done = waitpid(pid, NULL, WNOHANG);
+
+        if (done == pid || (done == -1 && errno != EINTR))
+            return 1;
+        if (waited >= ms)
+            return 0;
+
+        nanosleep(&step, NULL);
+    }
+}
+
+// Function closes a helper's connection and reaps it
+static void stop_helper(Helper *helper)
+{
+    // Closing the socket gives the helper EOF, the signals cover helpers that don't exit on it
+    close(helper->fd);
+    free(helper->input);
+
+    if (reap_helper(helper->pid, SHELL_COPROC_STOP_MS))
+        return;
+
+    kill(helper->pid, SIGTERM);
+    if (reap_helper(helper->pid, SHELL_COPROC_STOP_MS))
+        return;
+    // SIGKILL can't be ignored so this wait always ends
+    kill(helper->pid, SIGKILL);
+    waitpid(helper->pid, NULL, 0);
+}
+
+// Function starts a named pool of size helpers all running the same command
+int start_pool(char *name, int size, char **command)
+{
+    if (find_pool(name) != NULL)
+    {
+        fprintf(stderr, "coproc: %s is already running\n", name);
+        return 0;
+    }
+    // Resize the pool list if necessary
+    if (Pools.count == Pools.size)
+    {
+        Pools.size = Pools.size == 0 ? 4 : Pools.size * 2;
+        Pools.pool = realloc(Pools.pool, sizeof(HelperPool) * Pools.size);
+        if (!Pools.pool)
+        {
+            fprintf(stderr, "Shell Allocation Error\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    HelperPool *pool = &Pools.pool[Pools.count];
+
+    pool->name = strdup(name);
+    pool->helpers = malloc(sizeof(Helper) * size);
+    pool->count = 0;
+    pool->next = 0;
+
+    if (!pool->name || !pool->helpers)
+    {
+        fprintf(stderr, "Shell Allocation Error\n");
+        exit(EXIT_FAILURE);
+    }
+    // Start every helper, stopping the ones already running on failure
+    for (int i = 0; i < size; i++)
+    {
+        if (!start_helper(&pool->helpers[i], command))
+        {
+            for (int j = 0; j < pool->count; j++)
+            {
+                stop_helper(&pool->helpers[j]);
+            }
+
+            free(pool->helpers);
+            free(pool->name);
+            return 0;
+        }
+
+        pool->count++;
+    }
+
+    Pools.count++;
+
+    return 1;
+}
+
+// Function stops every helper in a pool and removes the pool, returns 0 if there's no such pool
+int stop_pool(char *name)
+{
+    HelperPool *pool = find_pool(name);
+
+    if (pool == NULL)
+    {
+        fprintf(stderr, "coproc: %s: no such coprocess\n", name);
+        return 0;
+    }
+
+    for (int i = 0; i < pool->count; i++)
+    {
+        stop_helper(&pool->helpers[i]);
+    }
+
+    free(pool->helpers);
+    free(pool->name);
+    // Move the last pool into the free slot
+    *pool = Pools.pool[--Pools.count];
+
+    return 1;
+}
+
+// Function gets the milliseconds left until a deadline
+static int remaining_ms(struct timespec *deadline)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    long ms = (deadline->tv_sec - now.tv_sec) * 1000L + (deadline->tv_nsec - now.tv_nsec) / 1000000L;
+
+    return ms > 0 ? (int)ms : 0;
+}
+
+// Function reads the next response line of a helper, waiting at most SHELL_COPROC_TIMEOUT_MS
+// Lines owed to earlier requests that timed out are skipped, returns the length or -1
+static int read_response(Helper *helper, char **response, size_t *response_size)
+{
+    struct timespec deadline;
+
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += SHELL_COPROC_TIMEOUT_MS / 1000;
+    deadline.tv_nsec += (SHELL_COPROC_TIMEOUT_MS % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L)
+    {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    for (;;)
+    {
+        char *newline = helper->length > 0 ? memchr(helper->input, '\n', helper->length) : NULL;
+        // Hand back a complete line, dropping the ones nobody is waiting for anymore
+        if (newline != NULL)
+        {
+            size_t line_length = newline - helper->input + 1;
+            int stale = helper->stale > 0;
+
+            if (stale)
+            {
+                helper->stale--;
+            }
+            else
+            {
+                if (line_length + 1 > *response_size)
+                {
+                    *response_size = line_length + 1;
+                    *response = realloc(*response, *response_size);
+                    if (!*response)
+                    {
+                        fprintf(stderr, "Shell Allocation Error\n");
+                        exit(EXIT_FAILURE);
+                    }
+                }
+
+                memcpy(*response, helper->input, line_length);
+                (*response)[line_length] = '\0';
+            }
+
+            helper->length -= line_length;
+            memmove(helper->input, newline + 1, helper->length);
+
+            if (!stale)
+                return (int)line_length;
+            continue;
+        }
+        // Wait for more output
+        struct pollfd pfd = {helper->fd, POLLIN, 0};
+        int ready = poll(&pfd, 1, remaining_ms(&deadline));
+
+        if (ready == 0)
+        {
+            helper->stale++;
+            fprintf(stderr, "send: helper %d did not answer within %dms\n", helper->pid, SHELL_COPROC_TIMEOUT_MS);
+            return -1;
+        }
+
+        if (ready == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            perror("send");
+            return -1;
+        }
+
+        if (helper->length + SHELL_COPROC_BUFSIZE > helper->size)
+        {
+            helper->size = helper->length + SHELL_COPROC_BUFSIZE;
+            helper->input = realloc(helper->input, helper->size);
+            if (!helper->input)
+            {
+                fprintf(stderr, "Shell Allocation Error\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        ssize_t n = read(helper->fd, helper->input + helper->length, helper->size - helper->length);
+        // The helper exited
+        if (n <= 0)
+            return -1;
+
+        helper->length += n;
+    }
+}
+
+// Function sends the words as one line to the next helper of the pool and reads one line back
+// The response is stored in a buffer that is reused across calls, it returns its length or -1
+int pool_request(HelperPool *pool, char **words, int size, char **response, size_t *response_size)
+{
+    static char *request = NULL;
+    static size_t request_buffer_size = 0;
+    size_t request_size = 0;
+    // Join the words with single spaces into a buffer that is reused across calls
+    for (int i = 0; i < size; i++)
+    {
+        request_size += strlen(words[i]) + 1;
+    }
+
+    if (request_size + 1 > request_buffer_size)
+    {
+        request_buffer_size = request_size + 1;
+        request = realloc(request, request_buffer_size);
+        if (!request)
+        {
+            fprintf(stderr, "Shell Allocation Error\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    request_size = 0;
+    for (int i = 0; i < size; i++)
+    {
+        size_t length = strlen(words[i]);
+
+        memcpy(request + request_size, words[i], length);
+        request_size += length;
+        request[request_size++] = ' ';
+    }
+    // The last separator becomes the newline, an empty request is just the newline
+    if (request_size == 0)
+        request_size++;
+    request[request_size - 1] = '\n';
+    // Round robin over the helpers
+    Helper *helper = &pool->helpers[pool->next];
+    pool->next = (pool->next + 1) % pool->count;
+
+    size_t sent = 0;
+    while (sent < request_size)
+    {
+        ssize_t n = send(helper->fd, request + sent, request_size - sent, MSG_NOSIGNAL);
+
+        if (n == -1)
+        {
+            perror("send");
+            return -1;
+        }
+
+        sent += n;
+    }
+
+    return read_response(helper, response, response_size);
+}
+
+// Function starts, lists or stops coprocess pools
+// coproc [-n N] NAME command [args], coproc -k NAME, coproc
+int shell_coproc(char **args, int size, int status)
+{
+    int pool_size = SHELL_COPROC_DEFAULT_SIZE;
+    int i = 1;
+    // List the running pools
+    if (size == 1)
+    {
+        for (int p = 0; p < Pools.count; p++)
+        {
+            printf("%s:", Pools.pool[p].name);
+            for (int h = 0; h < Pools.pool[p].count; h++)
+            {
+                printf(" %d", Pools.pool[p].helpers[h].pid);
+            }
+            printf("\n");
+        }
+
+        return 1;
+    }
+    // Stop a pool
+    if (strcmp(args[1], "-k") == 0)
+    {
+        if (size != 3)
+        {
+            fprintf(stderr, "usage: coproc -k NAME\n");
+            LastStatus = W_EXITCODE(1, 0);
+            return 1;
+        }
+
+        if (!stop_pool(args[2]))
+            LastStatus = W_EXITCODE(1, 0);
+        return 1;
+    }
+    // Read the pool size
+    if (strcmp(args[1], "-n") == 0 && size > 2)
+    {
+        pool_size = atoi(args[2]);
+        i = 3;
+
+        if (pool_size < 1 || pool_size > SHELL_COPROC_MAX_SIZE)
+        {
+            fprintf(stderr, "coproc: pool size must be between 1 and %d\n", SHELL_COPROC_MAX_SIZE);
+            LastStatus = W_EXITCODE(1, 0);
+            return 1;
+        }
+    }
+
+    if (size - i < 2)
+    {
+        fprintf(stderr, "usage: coproc [-n N] NAME command [args]\n");
+        LastStatus = W_EXITCODE(1, 0);
+        return 1;
+    }
+
+    if (!start_pool(args[i], pool_size, args + i + 1))
+        LastStatus = W_EXITCODE(1, 0);
+
+    return 1;
+}
+
+// Function sends a request line to a coprocess pool and prints the response line
+int shell_send(char **args, int size, int status)
+{
+    static char *response = NULL;
+    static size_t response_size = 0;
+
+    if (size < 2)
+    {
+        fprintf(stderr, "usage: send NAME [words]\n");
+        LastStatus = W_EXITCODE(1, 0);
+        return 1;
+    }
+
+    HelperPool *pool = find_pool(args[1]);
+
+    if (pool == NULL)
+    {
+        fprintf(stderr, "send: %s: no such coprocess\n", args[1]);
+        LastStatus = W_EXITCODE(1, 0);
+        return 1;
+    }
+
+    int length = pool_request(pool, args + 2, size - 2, &response, &response_size);
+
+    if (length == -1)
+    {
+        fprintf(stderr, "send: %s: no response\n", args[1]);
+        LastStatus = W_EXITCODE(1, 0);
+        return 1;
+    }
+
+    fwrite(response, 1, length, stdout);
+
+    return 1;
+}
+
+// Function stops every pool and frees the pool list
+void destroy_pools(void)
+{
+    while (Pools.count > 0)
+    {
+        stop_pool(Pools.pool[0].name);
+    }
+
+    free(Pools.pool);
+    Pools.pool = NULL;
+    Pools.size = 0;
+}
@@ -0,0 +1,65 @@
+//
+//  coproc.h
+//  Shell
+//
+//  Named pools of persistent helper processes that answer one line per request.
+//  Helpers must flush each response line, a helper that buffers its stdout when it
+//  isn't a terminal (sed without -u, tr, most formatters) times out instead of answering.
+//
+
+#ifndef coproc_h
+#define coproc_h
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <poll.h>
+#include <time.h>
+#include <errno.h>
+
+#define SHELL_COPROC_DEFAULT_SIZE 1
+#define SHELL_COPROC_MAX_SIZE 64
+#define SHELL_COPROC_TIMEOUT_MS 5000 // How long send waits for a response line
+#define SHELL_COPROC_BUFSIZE 1024
+#define SHELL_COPROC_STOP_MS 200 // How long a stopping helper gets after EOF and again after SIGTERM
+
+typedef struct
+{
+    pid_t pid;
+    int fd;       // Shell end of the socket pair, the helper has the other end as stdin and stdout
+    char *input;  // Bytes read from the helper that aren't part of a returned response yet
+    size_t length;
+    size_t size;
+    int stale;    // Responses still owed to requests that timed out, dropped when they arrive
+} Helper;
+
+typedef struct
+{
+    char *name;
+    Helper *helpers;
+    int count;
+    int next; // Helper that gets the next request
+} HelperPool;
+
+typedef struct
+{
+    HelperPool *pool;
+    int size;
+    int count;
+} HelperPools;
+
+int shell_coproc(char **, int, int);
+int shell_send(char **, int, int);
+
+HelperPool *find_pool(char *);
+int start_pool(char *, int, char **);
+int stop_pool(char *);
+int pool_request(HelperPool *, char **, int, char **, size_t *);
+void destroy_pools(void);
+
+#endif /* coproc_h */
@@ -0,0 +1,242 @@
+//
+//  launch.c
+//  Shell
+//
+//  Resource limits, CPU affinity, priority and cgroup placement for child processes.
+//
+
+#include "launch.h"
+
+// Function resets the launch options so nothing is applied to the child
+void init_launch_options(LaunchOptions *opts)
+{
+    memset(opts, 0, sizeof(LaunchOptions));
+    CPU_ZERO(&opts->cpus);
+}
+
+// Function parses a cpu list such as 0-3,6 into a cpu set
+int parse_cpu_list(char *list, cpu_set_t *set)
+{
+    char *end;
+
+    CPU_ZERO(set);
+    while (*list != '\0')
+    {
+        long first = strtol(list, &end, 10);
+        long last = first;
+
+        if (end == list || first < 0)
+            return 0;
+        // Check for a range
+        if (*end == '-')
+        {
+            list = end + 1;
+            last = strtol(list, &end, 10);
+
+            if (end == list || last < first)
+                return 0;
+        }
+
+        if (last >= CPU_SETSIZE)
+            return 0;
+
+        for (long cpu = first; cpu <= last; cpu++)
+        {
+            CPU_SET(cpu, set);
+        }
+        // Move past the separator
+        if (*end == ',')
+            end++;
+        else if (*end != '\0')
+            return 0;
+
+        list = end;
+    }
+
+    return CPU_COUNT(set) > 0;
+}
+
+// Function parses a size such as 512K, 2G or unlimited into bytes
+int parse_size(char *str, rlim_t *size)
+{
+    char *end;
+
+    if (strcmp(str, "unlimited") == 0)
+    {
+        *size = RLIM_INFINITY;
+        return 1;
+    }
+
+    errno = 0;
+    unsigned long long value = strtoull(str, &end, 10);
+    int shift = 0;
+
+    if (end == str || *str == '-' || errno == ERANGE)
+        return 0;
+    // Apply the unit suffix if there is one
+    switch (*end)
+    {
+    case 'G':
+    case 'g':
+        shift += 10;
+        // Fall through
+    case 'M':
+    case 'm':
+        shift += 10;
+        // Fall through
+    case 'K':
+    case 'k':
+        shift += 10;
+        end++;
+        break;
+    default:
+        break;
+    }
+
+    if (*end != '\0')
+        return 0;
+    // Sizes that don't fit or collide with RLIM_INFINITY are rejected rather than wrapped
+    if (value > ((unsigned long long)(RLIM_INFINITY - 1) >> shift))
+        return 0;
+
+    value <<= shift;
+
+    *size = (rlim_t)value;
+
+    return 1;
+}
+
+// Function parses the options of the run builtin
+// Options stop at the first word that doesn't start with -- or at a bare --
+int parse_launch_options(char **args, int size, LaunchOptions *opts)
+{
+    int i;
+
+    for (i = 1; i < size; i++)
+    {
+        char *arg = args[i];
+
+        if (strncmp(arg, SHELL_RUN_OPTION_PREFIX, 2) != 0)
+            break;
+        // End of options
+        if (arg[2] == '\0')
+        {
+            i++;
+            break;
+        }
+
+        if (strncmp(arg, "--cpus=", 7) == 0)
+        {
+            if (!parse_cpu_list(arg + 7, &opts->cpus))
+            {
+                fprintf(stderr, "run: invalid cpu list %s\n", arg + 7);
+                return 0;
+            }
+
+            opts->has_cpus = 1;
+        }
+        else if (strncmp(arg, "--nice=", 7) == 0)
+        {
+            char *end;
+
+            opts->nice = (int)strtol(arg + 7, &end, 10);
+
+            if (end == arg + 7 || *end != '\0')
+            {
+                fprintf(stderr, "run: invalid nice value %s\n", arg + 7);
+                return 0;
+            }
+
+            opts->has_nice = 1;
+        }
+        else if (strncmp(arg, "--mem=", 6) == 0)
+        {
+            if (!parse_size(arg + 6, &opts->mem))
+            {
+                fprintf(stderr, "run: invalid memory size %s\n", arg + 6);
+                return 0;
+            }
+
+            opts->has_mem = 1;
+        }
+        else if (strncmp(arg, "--cgroup=", 9) == 0)
+        {
+            char procs[4096];
+
+            snprintf(procs, sizeof(procs), "%s/cgroup.procs", arg + 9);
+            // Only cgroups that this user can write to can be joined
+            if (access(procs, W_OK) != 0)
+            {
+                fprintf(stderr, "run: cgroup %s is not writable\n", arg + 9);
+                return 0;
+            }
+
+            opts->cgroup = arg + 9;
+        }
+        else
+        {
+            fprintf(stderr, "run: unknown option %s\n", arg);
+            return 0;
+        }
+    }
+
+    if (i >= size)
+    {
+        fprintf(stderr, "usage: run [--cpus=LIST] [--nice=N] [--mem=SIZE] [--cgroup=DIR] command [args]\n");
+        return 0;
+    }
+
+    opts->command = i;
+
+    return 1;
+}
+
+// Function applies the launch options to the calling process
+// Called in the child between fork and exec
+int apply_launch_options(LaunchOptions *opts)
+{
+    if (opts == NULL)
+        return 1;
+    // Join the cgroup first so the other limits are charged to it
+    if (opts->cgroup != NULL)
+    {
+        char procs[4096];
+
+        snprintf(procs, sizeof(procs), "%s/cgroup.procs", opts->cgroup);
+
+        int fd = open(procs, O_WRONLY);
+        // Writing 0 moves the writing process
+        if (fd == -1 || write(fd, "0\n", 2) != 2)
+        {
+            perror("run: cgroup");
+            return 0;
+        }
+
+        close(fd);
+    }
+
+    if (opts->has_nice && setpriority(PRIO_PROCESS, 0, opts->nice) == -1)
+    {
+        perror("run: setpriority");
+        return 0;
+    }
+
+    if (opts->has_cpus && sched_setaffinity(0, sizeof(cpu_set_t), &opts->cpus) == -1)
+    {
+        perror("run: sched_setaffinity");
+        return 0;
+    }
+
+    if (opts->has_mem)
+    {
+        struct rlimit limit = {opts->mem, opts->mem};
+
+        if (setrlimit(RLIMIT_AS, &limit) == -1)
+        {
+            perror("run: setrlimit");
+            return 0;
+        }
+    }
+
+    return 1;
+}
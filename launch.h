@@ -0,0 +1,41 @@
+//
+//  launch.h
+//  Shell
+//
+//  Resource limits, CPU affinity, priority and cgroup placement for child processes.
+//
+
+#ifndef launch_h
+#define launch_h
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/resource.h>
+
+#define SHELL_RUN_OPTION_PREFIX "--"
+
+typedef struct
+{
+    int command;     // Index of the command word in the args (past the run options)
+    int has_nice;
+    int nice;        // Priority applied with setpriority
+    int has_cpus;
+    cpu_set_t cpus;  // Affinity mask applied with sched_setaffinity
+    int has_mem;
+    rlim_t mem;      // Address space limit in bytes (RLIMIT_AS)
+    char *cgroup;    // cgroup v2 directory the child joins before exec
+} LaunchOptions;
+
+void init_launch_options(LaunchOptions *);
+int parse_launch_options(char **, int, LaunchOptions *);
+int apply_launch_options(LaunchOptions *);
+int parse_cpu_list(char *, cpu_set_t *);
+int parse_size(char *, rlim_t *);
+
+#endif /* launch_h */
@@ -70,48 +70,19 @@ int is_operator_character(char c, char nc)
     return (c == '&' && (nc == '\0' || nc == '\n')) || ((c == '>' || c == '<') && (nc != '\0' && nc != '\n' && nc == ' '));
 }
 
-// Function copys a string to the heap
-char *copy_substring(char *input, int start, int end)
+// Function parses a string for operators and inserts each word into a list
+List *parse_input(char *input)
 {
-    int i, x = 0;
-    char *substr = malloc((end - start + 1) * sizeof(char));
-    for (i = start; i < end; i++)
-    {
-        // expand the pid
-        // Check if there are two $
-        if (i + 1 < end && input[i] == '$' && input[i + 1] == '$')
-        {
-            char strpid[10];
-            pid_t pid = getpid();
-            sprintf(strpid, "%d", pid);
-            // Resize the string to contain the pid
-            substr = realloc(substr, (sizeof(substr) - 1 + strlen(strpid)) * sizeof(char));
-            // Add in the pid char by char
-            for (int y = 0; y < strlen(strpid); y++)
-            {
-                substr[x++] = strpid[y];
-            }
-
-            i++;
-        }
-        else
-        {
-            substr[x++] = input[i];
-        }
-    }
-    // Add null terminator at the end
-    substr[x] = '\0';
-
-    return substr;
+    return parse_input_into(createList(), input);
 }
 
-// Function parses a string for operators and expands $$ and inserts each word into a list
-List *parse_input(char *input)
+// Function parses a string into an existing list, reusing the memory it already holds
+List *parse_input_into(List *lst, char *input)
 {
-    // Create the list
-    List *lst = createList();
     int input_length = (int)strlen(input);
     int input_position = 0;
+
+    listReset(lst);
     // While the end of the line hasn't been reached
     // Outer loop is for entire string
     while (input[input_position] != '\0' && input_position < input_length)
@@ -120,33 +91,28 @@ List *parse_input(char *input)
         skip_whitespace(input, &input_position);
         skip_comments(input, &input_position);
         // Inner loop is for each distinct commands seperated by the operators
-        // Prepare the token array for strings
-        int token_position = 0;
-        int token_size = SHELL_TOK_BUFSIZE;
         char ops = '\0';
-        char **tokens = malloc(token_size * sizeof(char *));
-        // Make sure memory was allocated
-        if (!tokens)
-        {
-            fprintf(stderr, "Shell Allocation Error\n");
-            exit(EXIT_FAILURE);
-        }
         // While the end of the string hasn't been reached
         while (input[input_position] != '\0')
         {
             // Skip white space and comments
             skip_whitespace(input, &input_position);
             skip_comments(input, &input_position);
-            // Add words into the tokens array
+            // Stop before looking past the end of the string
+            if (input[input_position] == '\0')
+            {
+                break;
+            }
+            // Add words into the list's buffers
             if (is_word(input[input_position], input[input_position + 1]))
             {
                 int start = input_position;
-                while (is_word(input[input_position], input[input_position + 1]) && input[input_position] != '\0')
+                while (input[input_position] != '\0' && is_word(input[input_position], input[input_position + 1]))
                 {
                     input_position++;
                 }
 
-                tokens[token_position++] = copy_substring(input, start, input_position);
+                listAppendToken(lst, input, start, input_position);
             }
             // This is the end of the command if the operator has been found
             else if (is_operator_character(input[input_position], input[input_position + 1]))
@@ -156,61 +122,155 @@ List *parse_input(char *input)
             }
             // Skip trailing whitespace
             skip_whitespace(input, &input_position);
-            // Resize the tokens array if necessary
-            if (token_position >= token_size)
-            {
-                token_size += SHELL_TOK_BUFSIZE;
-                tokens = realloc(tokens, token_size * sizeof(char *));
-                if (!tokens)
-                {
-                    fprintf(stderr, "Shell Allocation Error\n");
-                    exit(EXIT_FAILURE);
-                }
-            }
         }
-        // Terminate the tokens array
-        tokens[token_position] = NULL;
-        // Add the args and operator to the list
-        listAppend(lst, tokens, ops, token_position);
-        // Reset the ops char
-        ops = '\0';
+        // Terminate the command and record its operator
+        listEndCommand(lst, ops);
     }
+    // Point the commands at their args now that the buffers won't move
+    listResolve(lst);
 
     return lst;
 }
 
+// Function grows a buffer so it can hold at least needed elements
+static void *grow_buffer(void *buffer, int *size, int needed, size_t element)
+{
+    if (needed <= *size)
+        return buffer;
+
+    while (*size < needed)
+    {
+        *size *= 2;
+    }
+
+    buffer = realloc(buffer, element * *size);
+    if (!buffer)
+    {
+        fprintf(stderr, "Shell Allocation Error\n");
+        exit(EXIT_FAILURE);
+    }
+
+    return buffer;
+}
+
+// Function grows the argv and offsets arrays together since they share a size
+static void grow_args(List *l, int needed)
+{
+    int size = l->argv_size;
+
+    l->argv = grow_buffer(l->argv, &size, needed, sizeof(char *));
+    l->offsets = grow_buffer(l->offsets, &l->argv_size, needed, sizeof(int));
+}
+
 // Function creates and initializes a list data structure
 List *createList()
+{
+    return createListSized(10, SHELL_TOK_BUFSIZE, SHELL_LIST_BUFSIZE);
+}
+
+// Function creates a list with room for count commands, argc args and length characters
+List *createListSized(int count, int argc, int length)
 {
     List *lst = (List *)malloc(sizeof(List));
-    lst->size = 10;
-    lst->count = 0;
-    lst->iterator = 0;
-    lst->container = (InputNode **)malloc(sizeof(InputNode) * lst->size);
+
+    if (!lst)
+    {
+        fprintf(stderr, "Shell Allocation Error\n");
+        exit(EXIT_FAILURE);
+    }
+    // Buffers grow by doubling so they can't start empty
+    lst->size = count > 0 ? count : 1;
+    lst->argv_size = argc > 0 ? argc : 1;
+    lst->buffer_size = length > 0 ? length : 1;
+    lst->container = malloc(sizeof(InputNode) * lst->size);
+    lst->argv = malloc(sizeof(char *) * lst->argv_size);
+    lst->offsets = malloc(sizeof(int) * lst->argv_size);
+    lst->buffer = malloc(sizeof(char) * lst->buffer_size);
+
+    if (!lst->container || !lst->argv || !lst->offsets || !lst->buffer)
+    {
+        fprintf(stderr, "Shell Allocation Error\n");
+        exit(EXIT_FAILURE);
+    }
+
+    listReset(lst);
 
     return lst;
 }
 
-// Function appends a node to the list
-void listAppend(List *l, char **input, char operator, int size)
+// Function copies a list into a new one sized exactly for it, for lists that are kept around
+List *listCopy(List *l)
+{
+    List *copy = createListSized(l->count, l->argc, l->buffer_length);
+
+    memcpy(copy->container, l->container, sizeof(InputNode) * l->count);
+    memcpy(copy->offsets, l->offsets, sizeof(int) * l->argc);
+    memcpy(copy->buffer, l->buffer, l->buffer_length);
+    copy->count = l->count;
+    copy->argc = l->argc;
+    copy->buffer_length = l->buffer_length;
+    listResolve(copy);
+
+    return copy;
+}
+
+// Function empties the list but keeps its buffers for the next line
+void listReset(List *l)
 {
+    l->count = 0;
+    l->iterator = 0;
+    l->argc = 0;
+    l->buffer_length = 0;
+}
+
+// Function copies a word into the list's buffer
+void listAppendToken(List *l, char *input, int start, int end)
+{
+    int length = end - start;
+
+    l->buffer = grow_buffer(l->buffer, &l->buffer_size, l->buffer_length + length + 1, sizeof(char));
+    grow_args(l, l->argc + 1);
+    l->offsets[l->argc++] = l->buffer_length;
+
+    memcpy(l->buffer + l->buffer_length, input + start, length);
+    l->buffer_length += length;
+    // Add null terminator at the end
+    l->buffer[l->buffer_length++] = '\0';
+}
+
+// Function closes the command made of the tokens appended since the last one
+void listEndCommand(List *l, char operator)
+{
+    int start = l->count > 0 ? l->container[l->count - 1].start + l->container[l->count - 1].size + 1 : 0;
+    int size = l->argc - start;
+
     if (size == 0)
     {
         return;
     }
-
+    // Terminate the args of the command
+    grow_args(l, l->argc + 1);
+    l->offsets[l->argc++] = -1;
     // Setup the node
-    InputNode *node = malloc(sizeof(InputNode));
-    node->line = input;
-    node->ops = operator;
-    node->size = size;
-    // Add the node and increment the count
-    l->container[l->count++] = node;
-    // Resize if necessary
-    if (l->size == l->count)
+    l->container = grow_buffer(l->container, &l->size, l->count + 1, sizeof(InputNode));
+    l->container[l->count].line = NULL;
+    l->container[l->count].start = start;
+    l->container[l->count].size = size;
+    l->container[l->count].ops = operator;
+    l->count++;
+}
+
+// Function turns the offsets into pointers once the buffers are done growing
+void listResolve(List *l)
+{
+    for (int i = 0; i < l->argc; i++)
+    {
+        l->argv[i] = l->offsets[i] < 0 ? NULL : l->buffer + l->offsets[i];
+    }
+
+    for (int i = 0; i < l->count; i++)
     {
-        l->size *= 2;
-        l->container = realloc(l->container, sizeof(InputNode) * l->size);
+        l->container[i].line = l->argv + l->container[i].start;
     }
 }
 
@@ -220,7 +280,7 @@ InputNode *listNextNode(List *l)
     if (!l || l->count == 0 || l->iterator >= l->count)
         return NULL;
 
-    return l->container[l->iterator++];
+    return &l->container[l->iterator++];
 }
 
 // Function checks if there's a next node from the current iterator position
@@ -238,27 +298,15 @@ int listIsEmpty(List *l)
     return l->count == 0;
 }
 
-// Function frees an input node and the list of args it holds
-void freeInputNode(InputNode *in)
-{
-    if (!in)
-        return;
-
-    if (in->line)
-    {
-        free(in->line);
-    }
-
-    free(in);
-}
-
-// Fucntion destroys the nodes in a list and the list itself
+// Fucntion destroys the buffers of a list and the list itself
 void destroyList(List *l)
 {
-    for (int i = 0; i < l->count; i++)
-    {
-        freeInputNode(l->container[i]);
-    }
+    if (!l)
+        return;
 
+    free(l->container);
+    free(l->argv);
+    free(l->offsets);
+    free(l->buffer);
     free(l);
 }
@@ -20,20 +20,31 @@
 #define SHELL_TOK_BUFSIZE 64
 #define SHELL_FLAG_CHARACTER "-"
 
-typedef struct InputNode
+#define SHELL_LIST_BUFSIZE 256
+
+// A command is a window into the list's argv, it owns no memory of its own
+typedef struct
 {
-    char **line;
+    char **line; // NULL terminated args, points into the list's argv
+    int start;   // Offset of the first arg in the list's argv
     int size;
     char ops;
-    struct InputNode *next;
 } InputNode;
 
+// Every command of a line lives in four contiguous buffers owned by the list
 typedef struct
 {
-    InputNode **container;
+    InputNode *container; // Commands in order
+    char **argv;          // Args of every command, each command is NULL terminated
+    int *offsets;         // Offset of each arg in buffer, -1 marks a terminator
+    char *buffer;         // Characters of every arg, NUL separated
     int iterator;
     int size;
     int count;
+    int argc;
+    int argv_size;
+    int buffer_length;
+    int buffer_size;
 } List;
 
 void skip_whitespace(char *, int *);
@@ -43,16 +54,19 @@ int is_letter(char);
 int is_number(char);
 int is_word(char, char);
 int is_operator_character(char, char);
-char *copy_substring(char *, int, int);
 List *parse_input(char *);
+List *parse_input_into(List *, char *);
 
 List *createList();
-void listAppend(List *, char **, char, int);
+List *createListSized(int, int, int);
+List *listCopy(List *);
+void listReset(List *);
+void listAppendToken(List *, char *, int, int);
+void listEndCommand(List *, char);
+void listResolve(List *);
 InputNode *listNextNode(List *);
 int listHasNext(List *);
-void listPop(List *);
 int listIsEmpty(List *);
-void freeInputNode(InputNode *);
 void destroyList(List *);
 
 #endif /* lexer_h */
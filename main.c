@@ -10,6 +10,10 @@
 
 int main(int argc, const char *argv[])
 {
+    clock_gettime(CLOCK_MONOTONIC, &StartupBegin);
+    // -t reports how long loading the rc file took
+    StartupReport = argc > 1 && strcmp(argv[1], "-t") == 0;
+
     shell_loop();
 
     return EXIT_SUCCESS;
@@ -0,0 +1,539 @@
+//
+//  rc.c
+//  Shell
+//
+//  Startup file loading with a precompiled snapshot of the compiled rc file.
+//
+
+#include "rc.h"
+
+int StartupReport = 0;              // Print how long startup took
+struct timespec StartupBegin = {0}; // When main started
+
+// Bounds checked cursor over a mapped snapshot
+typedef struct
+{
+    const char *data;
+    size_t size;
+    size_t position;
+    int failed;
+} Reader;
+
+// Function gets the microseconds between two times
+static long elapsed_us(struct timespec *from, struct timespec *to)
+{
+    return (to->tv_sec - from->tv_sec) * 1000000L + (to->tv_nsec - from->tv_nsec) / 1000;
+}
+
+// Function hashes a buffer with 64 bit FNV-1a
+uint64_t snapshot_hash(const void *data, size_t size)
+{
+    const unsigned char *bytes = data;
+    uint64_t hash = 14695981039346656037ULL;
+
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+// Function finds the rc file, $SMALLSHRC or ~/.smallshrc
+char *rc_path(void)
+{
+    char *path = getenv(SHELL_RC_ENV);
+    char *home = getenv("HOME");
+
+    if (path != NULL)
+        return strdup(path);
+    if (home == NULL)
+        return NULL;
+
+    char *full = malloc(strlen(home) + strlen(SHELL_RC_FILE) + 2);
+
+    if (!full)
+    {
+        fprintf(stderr, "Shell Allocation Error\n");
+        exit(EXIT_FAILURE);
+    }
+
+    sprintf(full, "%s/%s", home, SHELL_RC_FILE);
+
+    return full;
+}
+
+// Function writes a 32 bit integer to the snapshot
+static void write_int(FILE *out, int32_t value)
+{
+    fwrite(&value, sizeof(value), 1, out);
+}
+
+// Function writes a program and the functions it defines to the snapshot
+static void write_program(FILE *out, Program *prog)
+{
+    int32_t name_length = prog->name ? (int32_t)strlen(prog->name) : -1;
+
+    write_int(out, name_length);
+    if (name_length > 0)
+        fwrite(prog->name, 1, name_length, out);
+
+    write_int(out, prog->count);
+    write_int(out, prog->loops);
+    write_int(out, prog->command_count);
+    write_int(out, prog->body_count);
+    fwrite(prog->code, sizeof(Instruction), prog->count, out);
+    // Commands are stored as their flat buffers, the pointers are rebuilt on load
+    for (int i = 0; i < prog->command_count; i++)
+    {
+        List *cmd = prog->commands[i];
+
+        write_int(out, cmd->count);
+        write_int(out, cmd->argc);
+        write_int(out, cmd->buffer_length);
+
+        for (int j = 0; j < cmd->count; j++)
+        {
+            write_int(out, cmd->container[j].start);
+            write_int(out, cmd->container[j].size);
+            write_int(out, cmd->container[j].ops);
+        }
+
+        fwrite(cmd->offsets, sizeof(int), cmd->argc, out);
+        fwrite(cmd->buffer, 1, cmd->buffer_length, out);
+    }
+
+    for (int i = 0; i < prog->body_count; i++)
+    {
+        write_program(out, prog->bodies[i]);
+    }
+}
+
+// Function saves a compiled rc file next to it, written to a temporary file and renamed into place
+// so shells starting at the same time never see a partial snapshot
+int save_snapshot(char *path, struct stat *rc, Program *prog)
+{
+    char *payload = NULL;
+    size_t payload_size = 0;
+    FILE *stream = open_memstream(&payload, &payload_size);
+
+    if (!stream)
+        return 0;
+
+    write_program(stream, prog);
+    fclose(stream);
+
+    SnapshotHeader header;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SHELL_SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SHELL_SNAPSHOT_VERSION;
+    header.instruction_size = sizeof(Instruction);
+    header.rc_mtime_sec = rc->st_mtim.tv_sec;
+    header.rc_mtime_nsec = rc->st_mtim.tv_nsec;
+    header.rc_size = rc->st_size;
+    header.rc_inode = rc->st_ino;
+    header.payload_size = payload_size;
+    header.payload_hash = snapshot_hash(payload, payload_size);
+
+    char *temp = malloc(strlen(path) + 16);
+
+    if (!temp)
+    {
+        fprintf(stderr, "Shell Allocation Error\n");
+        exit(EXIT_FAILURE);
+    }
+
+    sprintf(temp, "%s.%d", path, getpid());
+    // The snapshot holds every string of the rc file so it's never readable by more people than the rc file
+    int fd = open(temp, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW, rc->st_mode & 0600);
+    FILE *out = fd != -1 ? fdopen(fd, "wb") : NULL;
+    int saved = 0;
+
+    if (fd != -1 && out == NULL)
+    {
+        close(fd);
+        unlink(temp);
+    }
+
+    if (out != NULL)
+    {
+        saved = fwrite(&header, sizeof(header), 1, out) == 1 && fwrite(payload, 1, payload_size, out) == payload_size;
+        saved = fclose(out) == 0 && saved && rename(temp, path) == 0;
+
+        if (!saved)
+            unlink(temp);
+    }
+
+    free(temp);
+    free(payload);
+
+    return saved;
+}
+
+// Function reads bytes from the snapshot, marking the reader as failed when it runs out
+static const void *read_bytes(Reader *r, size_t size)
+{
+    if (r->failed || size > r->size - r->position)
+    {
+        r->failed = 1;
+        return NULL;
+    }
+
+    const void *bytes = r->data + r->position;
+    r->position += size;
+
+    return bytes;
+}
+
+// Function reads a 32 bit integer from the snapshot
+static int32_t read_int(Reader *r)
+{
+    int32_t value = 0;
+    const void *bytes = read_bytes(r, sizeof(value));
+
+    if (bytes)
+        memcpy(&value, bytes, sizeof(value));
+
+    return value;
+}
+
+// Function reads a count and checks it against what's left of the snapshot
+static int read_count(Reader *r, size_t element)
+{
+    int32_t count = read_int(r);
+
+    if (count < 0 || (size_t)count * element > r->size - r->position)
+    {
+        r->failed = 1;
+        return 0;
+    }
+
+    return count;
+}
+
+// Function reads a command back into a list
+static List *read_command(Reader *r)
+{
+    int count = read_count(r, 3 * sizeof(int32_t));
+    int argc = read_count(r, sizeof(int32_t));
+    int length = read_count(r, 1);
+
+    if (r->failed)
+        return NULL;
+
+    List *cmd = createListSized(count, argc, length);
+
+    for (int i = 0; i < count; i++)
+    {
+        cmd->container[i].start = read_int(r);
+        cmd->container[i].size = read_int(r);
+        cmd->container[i].ops = (char)read_int(r);
+        // The args and their terminator must be inside argv
+        if (cmd->container[i].start < 0 || cmd->container[i].size < 0 || cmd->container[i].start + cmd->container[i].size >= argc)
+            r->failed = 1;
+    }
+
+    const void *offsets = read_bytes(r, sizeof(int) * argc);
+    const void *buffer = read_bytes(r, length);
+
+    if (r->failed)
+    {
+        destroyList(cmd);
+        return NULL;
+    }
+
+    memcpy(cmd->offsets, offsets, sizeof(int) * argc);
+    memcpy(cmd->buffer, buffer, length);
+    cmd->count = count;
+    cmd->argc = argc;
+    cmd->buffer_length = length;
+    // Every string must start inside the buffer, which ends with a terminator
+    if (length > 0 && cmd->buffer[length - 1] != '\0')
+        r->failed = 1;
+
+    for (int i = 0; i < argc && !r->failed; i++)
+    {
+        if (cmd->offsets[i] >= length || cmd->offsets[i] < -1)
+            r->failed = 1;
+    }
+    // Every command's args must be NULL terminated
+    for (int i = 0; i < count && !r->failed; i++)
+    {
+        if (cmd->offsets[cmd->container[i].start + cmd->container[i].size] != -1)
+            r->failed = 1;
+    }
+
+    if (r->failed)
+    {
+        destroyList(cmd);
+        return NULL;
+    }
+
+    listResolve(cmd);
+
+    return cmd;
+}
+
+// Function reads a program and the functions it defines from the snapshot
+// Function bodies are named, the rc file itself isn't
+static Program *read_program(Reader *r, int named)
+{
+    int32_t name_length = read_int(r);
+    const char *name = name_length > 0 ? read_bytes(r, name_length) : NULL;
+
+    if (named ? name_length <= 0 || (name && memchr(name, '\0', name_length)) : name_length != -1)
+        r->failed = 1;
+    if (r->failed)
+        return NULL;
+
+    Program *prog = create_program(NULL);
+
+    if (named)
+        prog->name = strndup(name, name_length);
+
+    int count = read_count(r, sizeof(Instruction));
+    prog->loops = read_int(r);
+    int command_count = read_count(r, 3 * sizeof(int32_t));
+    int body_count = read_count(r, sizeof(int32_t));
+    const char *code = read_bytes(r, sizeof(Instruction) * count);
+
+    if (r->failed)
+    {
+        release_program(prog);
+        return NULL;
+    }
+
+    // The code follows the name so it can be at any offset, copy each instruction out
+    for (int i = 0; i < count; i++)
+    {
+        Instruction in;
+
+        memcpy(&in, code + i * sizeof(Instruction), sizeof(Instruction));
+        program_emit(prog, in.op, in.arg, in.target);
+    }
+
+    for (int i = 0; i < command_count && !r->failed; i++)
+    {
+        List *cmd = read_command(r);
+
+        if (cmd)
+            program_add_command(prog, cmd);
+    }
+
+    for (int i = 0; i < body_count && !r->failed; i++)
+    {
+        Program *body = read_program(r, 1);
+
+        if (body)
+            program_add_body(prog, body);
+    }
+    // Every instruction must refer to something that exists
+    int loops = 0;
+
+    for (int i = 0; i < prog->count && !r->failed; i++)
+    {
+        Instruction *in = &prog->code[i];
+        int limit = in->op == OP_DEFINE ? prog->body_count : prog->command_count;
+
+        if (in->op < OP_EXEC || in->op > OP_RETURN || in->target < 0 || in->target > prog->count)
+            r->failed = 1;
+        else if ((in->op == OP_EXEC || in->op == OP_FOR_INIT || in->op == OP_FOR_NEXT || in->op == OP_DEFINE) && (in->arg < 0 || in->arg >= limit))
+            r->failed = 1;
+        else if (in->op == OP_FOR_INIT)
+        {
+            List *cmd = prog->commands[in->arg];
+            // NAME in words, the loop reads its name and words from the first command
+            if (cmd->count < 1 || cmd->container[0].size < 2)
+                r->failed = 1;
+            loops++;
+        }
+        // A loop is always entered through the OP_FOR_INIT right before its OP_FOR_NEXT
+        else if (in->op == OP_FOR_NEXT && (i == 0 || prog->code[i - 1].op != OP_FOR_INIT || prog->code[i - 1].arg != in->arg))
+            r->failed = 1;
+    }
+    // The loop state is only allocated for programs that say they have loops
+    if (loops != prog->loops)
+        r->failed = 1;
+
+    if (r->failed)
+    {
+        release_program(prog);
+        return NULL;
+    }
+
+    return prog;
+}
+
+// Function maps a snapshot and rebuilds the program if it matches the rc file
+Program *load_snapshot(char *path, struct stat *rc)
+{
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+
+    if (fd == -1)
+        return NULL;
+
+    // Anyone can recreate the header, so only trust snapshots nobody else could have written
+    if (fstat(fd, &st) == -1 || st.st_uid != getuid() || (st.st_mode & (S_IWGRP | S_IWOTH)) ||
+        st.st_size < (off_t)sizeof(SnapshotHeader))
+    {
+        close(fd);
+        return NULL;
+    }
+
+    char *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (data == MAP_FAILED)
+        return NULL;
+
+    SnapshotHeader *header = (SnapshotHeader *)data;
+    Program *prog = NULL;
+    // The snapshot is stale if it was made for another version of the rc file
+    if (memcmp(header->magic, SHELL_SNAPSHOT_MAGIC, sizeof(header->magic)) == 0 &&
+        header->version == SHELL_SNAPSHOT_VERSION &&
+        header->instruction_size == sizeof(Instruction) &&
+        header->rc_mtime_sec == rc->st_mtim.tv_sec &&
+        header->rc_mtime_nsec == rc->st_mtim.tv_nsec &&
+        header->rc_size == rc->st_size &&
+        header->rc_inode == rc->st_ino &&
+        header->payload_size == st.st_size - sizeof(SnapshotHeader) &&
+        header->payload_hash == snapshot_hash(data + sizeof(SnapshotHeader), header->payload_size))
+    {
+        Reader r = {data + sizeof(SnapshotHeader), header->payload_size, 0, 0};
+
+        prog = read_program(&r, 0);
+    }
+
+    munmap(data, st.st_size);
+
+    return prog;
+}
+
+// Function compiles the rc file
+static Program *compile_rc(char *path)
+{
+    FILE *in = fopen(path, "r");
+
+    if (in == NULL)
+        return NULL;
+
+    char *text = NULL;
+    size_t size = 0;
+    ssize_t length = getdelim(&text, &size, '\0', in);
+
+    fclose(in);
+    if (length < 0)
+    {
+        free(text);
+        return NULL;
+    }
+
+    int count = 0, lines_size = 64;
+    char **lines = malloc(sizeof(char *) * lines_size);
+
+    if (!lines)
+    {
+        fprintf(stderr, "Shell Allocation Error\n");
+        exit(EXIT_FAILURE);
+    }
+    // Split the text into lines in place
+    for (char *line = text; line != NULL && *line != '\0';)
+    {
+        char *newline = strchr(line, '\n');
+
+        if (newline)
+            *newline = '\0';
+
+        if (count == lines_size)
+        {
+            lines_size *= 2;
+            lines = realloc(lines, sizeof(char *) * lines_size);
+            if (!lines)
+            {
+                fprintf(stderr, "Shell Allocation Error\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        lines[count++] = line;
+        line = newline ? newline + 1 : NULL;
+    }
+
+    Program *prog = compile_script(lines, count);
+
+    free(lines);
+    free(text);
+
+    return prog;
+}
+
+// Function runs the rc file, from its snapshot when the snapshot is still valid
+// Returns 0 if the rc file asked the shell to exit
+int load_rc(struct Processes *proc)
+{
+    struct timespec begin, loaded, ran;
+    char *path = rc_path();
+    struct stat rc;
+
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+
+    if (path == NULL || stat(path, &rc) != 0)
+    {
+        if (StartupReport)
+        {
+            clock_gettime(CLOCK_MONOTONIC, &ran);
+            fprintf(stderr, "startup: no rc file, total %ldus\n", elapsed_us(&StartupBegin, &ran));
+        }
+
+        free(path);
+        return 1;
+    }
+
+    char *snapshot = malloc(strlen(path) + strlen(SHELL_SNAPSHOT_SUFFIX) + 1);
+
+    if (!snapshot)
+    {
+        fprintf(stderr, "Shell Allocation Error\n");
+        exit(EXIT_FAILURE);
+    }
+
+    sprintf(snapshot, "%s%s", path, SHELL_SNAPSHOT_SUFFIX);
+
+    char *source = "snapshot";
+    Program *prog = load_snapshot(snapshot, &rc);
+    // Compile the rc file and cache it for the next shell
+    if (prog == NULL)
+    {
+        source = "compiled";
+        prog = compile_rc(path);
+
+        if (prog != NULL && save_snapshot(snapshot, &rc, prog))
+            source = "compiled, snapshot saved";
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &loaded);
+
+    int status = 1;
+
+    if (prog != NULL)
+    {
+        status = run_program(prog, proc);
+        release_program(prog);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &ran);
+
+    if (StartupReport)
+    {
+        fprintf(stderr, "startup: %s (%s) load %ldus run %ldus total %ldus\n", path, source,
+                elapsed_us(&begin, &loaded), elapsed_us(&loaded, &ran), elapsed_us(&StartupBegin, &ran));
+    }
+
+    free(snapshot);
+    free(path);
+
+    return status;
+}
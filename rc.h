@@ -0,0 +1,52 @@
+//
+//  rc.h
+//  Shell
+//
+//  Startup file loading with a precompiled snapshot of the compiled rc file.
+//
+
+#ifndef rc_h
+#define rc_h
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "script.h"
+
+#define SHELL_RC_FILE ".smallshrc"
+#define SHELL_RC_ENV "SMALLSHRC"
+#define SHELL_SNAPSHOT_SUFFIX ".snapshot"
+#define SHELL_SNAPSHOT_MAGIC "SMSHSNAP"
+#define SHELL_SNAPSHOT_VERSION 1
+
+// The snapshot is only valid for the exact rc file it was compiled from
+typedef struct
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t instruction_size;
+    int64_t rc_mtime_sec;
+    int64_t rc_mtime_nsec;
+    int64_t rc_size;
+    uint64_t rc_inode;
+    uint64_t payload_size;
+    uint64_t payload_hash; // FNV-1a of the payload, catches torn or corrupt files
+} SnapshotHeader;
+
+extern int StartupReport;
+extern struct timespec StartupBegin;
+
+int load_rc(struct Processes *);
+char *rc_path(void);
+Program *load_snapshot(char *, struct stat *);
+int save_snapshot(char *, struct stat *, Program *);
+uint64_t snapshot_hash(const void *, size_t);
+
+#endif /* rc_h */
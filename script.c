@@ -0,0 +1,780 @@
+//
+//  script.c
+//  Shell
+//
+//  Control flow and functions compiled once into bytecode that is run directly.
+//
+
+#include "smallshell.h"
+
+Functions Funcs = {NULL, 0, 0};
+Frame Frames[SHELL_MAX_CALL_DEPTH];
+int CallDepth = 0;
+
+// What ended a block of lines
+typedef enum
+{
+    BLOCK_EOF,
+    BLOCK_DONE,
+    BLOCK_FI,
+    BLOCK_ELSE,
+    BLOCK_END,
+    BLOCK_ERROR
+} BlockEnd;
+
+// Loop being compiled, break and continue jump out of the innermost one
+typedef struct Loop
+{
+    int continue_target;
+    int *breaks; // Jumps to patch with the end of the loop
+    int count;
+    int size;
+} Loop;
+
+// Words of a running for loop
+typedef struct
+{
+    List *scratch; // Expanded words when the loop has variables
+    List *words;   // NAME in word...
+    int position;
+} LoopState;
+
+typedef struct
+{
+    char **lines;
+    int count;
+    int position;
+    List *scratch; // Every line is parsed here and copied out at its exact size
+} Compiler;
+
+// Function grows an array so it can hold one more element
+static void *grow_array(void *array, int *size, int count, size_t element)
+{
+    if (count < *size)
+        return array;
+
+    *size = *size == 0 ? 8 : *size * 2;
+    array = realloc(array, element * *size);
+    if (!array)
+    {
+        fprintf(stderr, "Shell Allocation Error\n");
+        exit(EXIT_FAILURE);
+    }
+
+    return array;
+}
+
+// Function checks if the first word of a line is the given keyword
+static int first_word_is(char *line, char *word)
+{
+    int position = 0;
+    int length = (int)strlen(word);
+
+    skip_whitespace(line, &position);
+
+    return strncmp(line + position, word, length) == 0 && (line[position + length] == '\0' || isspace(line[position + length]));
+}
+
+// Function tells how a line changes the nesting of blocks, used to know when a block has been read
+int script_block_depth(char *line)
+{
+    if (first_word_is(line, "for") || first_word_is(line, "while") || first_word_is(line, "if") || first_word_is(line, "function"))
+        return 1;
+    if (first_word_is(line, "done") || first_word_is(line, "fi") || first_word_is(line, "end"))
+        return -1;
+
+    return 0;
+}
+
+// Function creates an empty program
+Program *create_program(char *name)
+{
+    Program *prog = calloc(1, sizeof(Program));
+
+    if (!prog)
+    {
+        fprintf(stderr, "Shell Allocation Error\n");
+        exit(EXIT_FAILURE);
+    }
+
+    prog->name = name ? strdup(name) : NULL;
+    prog->refs = 1;
+
+    return prog;
+}
+
+// Function takes another reference to a program
+void retain_program(Program *prog)
+{
+    prog->refs++;
+}
+
+// Function drops a reference to a program and frees it with the last one
+void release_program(Program *prog)
+{
+    if (!prog || --prog->refs > 0)
+        return;
+
+    for (int i = 0; i < prog->command_count; i++)
+    {
+        destroyList(prog->commands[i]);
+    }
+
+    for (int i = 0; i < prog->body_count; i++)
+    {
+        release_program(prog->bodies[i]);
+    }
+
+    free(prog->commands);
+    free(prog->bodies);
+    free(prog->code);
+    free(prog->name);
+    free(prog);
+}
+
+// Function adds a lexed command to a program and returns its index
+int program_add_command(Program *prog, List *cmd)
+{
+    prog->commands = grow_array(prog->commands, &prog->command_size, prog->command_count, sizeof(List *));
+    prog->commands[prog->command_count] = cmd;
+
+    return prog->command_count++;
+}
+
+// Function adds a function body to a program and returns its index
+int program_add_body(Program *prog, Program *body)
+{
+    prog->bodies = grow_array(prog->bodies, &prog->body_size, prog->body_count, sizeof(Program *));
+    prog->bodies[prog->body_count] = body;
+
+    return prog->body_count++;
+}
+
+// Function appends an instruction to a program and returns its index
+int program_emit(Program *prog, int op, int arg, int target)
+{
+    prog->code = grow_array(prog->code, &prog->size, prog->count, sizeof(Instruction));
+    prog->code[prog->count].op = op;
+    prog->code[prog->count].arg = arg;
+    prog->code[prog->count].target = target;
+
+    return prog->count++;
+}
+
+// Function removes the keyword at the start of a command without lexing it again
+static int drop_keyword(List *cmd)
+{
+    if (cmd->container[0].size < 2)
+        return 0;
+
+    cmd->container[0].start++;
+    cmd->container[0].size--;
+    cmd->container[0].line++;
+
+    return 1;
+}
+
+// Function reports a syntax error at the current line
+static BlockEnd syntax_error(Compiler *c, char *message)
+{
+    fprintf(stderr, "Shell: line %d: syntax error: %s\n", c->position, message);
+
+    return BLOCK_ERROR;
+}
+
+static BlockEnd compile_block(Compiler *, Program *, Loop *);
+
+// Function compiles the body of a loop and points its breaks at the end
+static BlockEnd compile_loop_body(Compiler *c, Program *prog, int continue_target)
+{
+    Loop loop = {continue_target, NULL, 0, 0};
+    BlockEnd end = compile_block(c, prog, &loop);
+
+    if (end == BLOCK_DONE)
+    {
+        program_emit(prog, OP_JUMP, 0, continue_target);
+
+        for (int i = 0; i < loop.count; i++)
+        {
+            prog->code[loop.breaks[i]].target = prog->count;
+        }
+    }
+    else if (end != BLOCK_ERROR)
+    {
+        end = syntax_error(c, "expected done");
+    }
+
+    free(loop.breaks);
+
+    return end;
+}
+
+// Function compiles lines into a program until a line that ends the block
+static BlockEnd compile_block(Compiler *c, Program *prog, Loop *loop)
+{
+    while (c->position < c->count)
+    {
+        List *cmd = listCopy(parse_input_into(c->scratch, c->lines[c->position++]));
+
+        if (listIsEmpty(cmd))
+        {
+            destroyList(cmd);
+            continue;
+        }
+
+        char *word = cmd->container[0].line[0];
+        int single = cmd->count == 1 && cmd->container[0].size == 1;
+        // Words that end a block
+        BlockEnd end = BLOCK_EOF;
+
+        if (single && strcmp(word, "done") == 0)
+            end = BLOCK_DONE;
+        else if (single && strcmp(word, "fi") == 0)
+            end = BLOCK_FI;
+        else if (single && strcmp(word, "else") == 0)
+            end = BLOCK_ELSE;
+        else if (single && strcmp(word, "end") == 0)
+            end = BLOCK_END;
+
+        if (end != BLOCK_EOF)
+        {
+            destroyList(cmd);
+            return end;
+        }
+        // do and then are allowed on their own line for familiarity
+        if (single && (strcmp(word, "do") == 0 || strcmp(word, "then") == 0))
+        {
+            destroyList(cmd);
+        }
+        else if (strcmp(word, "for") == 0)
+        {
+            // for NAME in words
+            if (!drop_keyword(cmd) || cmd->container[0].size < 2 || strcmp(cmd->container[0].line[1], "in") != 0)
+            {
+                destroyList(cmd);
+                return syntax_error(c, "expected for NAME in words");
+            }
+
+            int index = program_add_command(prog, cmd);
+            program_emit(prog, OP_FOR_INIT, index, 0);
+            int next = program_emit(prog, OP_FOR_NEXT, index, 0);
+            prog->loops++;
+
+            if (compile_loop_body(c, prog, next) == BLOCK_ERROR)
+                return BLOCK_ERROR;
+
+            prog->code[next].target = prog->count;
+        }
+        else if (strcmp(word, "while") == 0)
+        {
+            if (!drop_keyword(cmd))
+            {
+                destroyList(cmd);
+                return syntax_error(c, "expected while command");
+            }
+
+            int condition = program_emit(prog, OP_EXEC, program_add_command(prog, cmd), 0);
+            int exit = program_emit(prog, OP_JUMP_IF_FALSE, 0, 0);
+
+            if (compile_loop_body(c, prog, condition) == BLOCK_ERROR)
+                return BLOCK_ERROR;
+
+            prog->code[exit].target = prog->count;
+        }
+        else if (strcmp(word, "if") == 0)
+        {
+            if (!drop_keyword(cmd))
+            {
+                destroyList(cmd);
+                return syntax_error(c, "expected if command");
+            }
+
+            program_emit(prog, OP_EXEC, program_add_command(prog, cmd), 0);
+            int skip = program_emit(prog, OP_JUMP_IF_FALSE, 0, 0);
+            BlockEnd end = compile_block(c, prog, loop);
+            // The true branch jumps over the else branch
+            if (end == BLOCK_ELSE)
+            {
+                int over = program_emit(prog, OP_JUMP, 0, 0);
+
+                prog->code[skip].target = prog->count;
+                skip = over;
+                end = compile_block(c, prog, loop);
+            }
+
+            if (end == BLOCK_ERROR)
+                return BLOCK_ERROR;
+            if (end != BLOCK_FI)
+                return syntax_error(c, "expected fi");
+
+            prog->code[skip].target = prog->count;
+        }
+        else if (strcmp(word, "function") == 0)
+        {
+            // function NAME
+            if (cmd->count != 1 || cmd->container[0].size != 2)
+            {
+                destroyList(cmd);
+                return syntax_error(c, "expected function NAME");
+            }
+
+            Program *body = create_program(cmd->container[0].line[1]);
+            destroyList(cmd);
+            // Loops outside of the function can't be left from inside it
+            BlockEnd end = compile_block(c, body, NULL);
+
+            if (end != BLOCK_END)
+            {
+                release_program(body);
+                return end == BLOCK_ERROR ? BLOCK_ERROR : syntax_error(c, "expected end");
+            }
+
+            program_emit(prog, OP_DEFINE, program_add_body(prog, body), 0);
+        }
+        else if (single && (strcmp(word, "break") == 0 || strcmp(word, "continue") == 0))
+        {
+            int is_break = word[0] == 'b';
+
+            destroyList(cmd);
+            if (loop == NULL)
+                return syntax_error(c, "break or continue outside of a loop");
+
+            if (is_break)
+            {
+                loop->breaks = grow_array(loop->breaks, &loop->size, loop->count, sizeof(int));
+                loop->breaks[loop->count++] = program_emit(prog, OP_JUMP, 0, 0);
+            }
+            else
+            {
+                program_emit(prog, OP_JUMP, 0, loop->continue_target);
+            }
+        }
+        else if (strcmp(word, "return") == 0 && cmd->count == 1 && cmd->container[0].size <= 2)
+        {
+            int value = cmd->container[0].size == 2 ? atoi(cmd->container[0].line[1]) & 0xff : -1;
+
+            destroyList(cmd);
+            program_emit(prog, OP_RETURN, value, 0);
+        }
+        else
+        {
+            program_emit(prog, OP_EXEC, program_add_command(prog, cmd), 0);
+        }
+    }
+
+    return BLOCK_EOF;
+}
+
+// Function compiles script lines into a program, returns NULL on a syntax error
+Program *compile_script(char **lines, int count)
+{
+    Compiler c = {lines, count, 0, createList()};
+    Program *prog = create_program(NULL);
+    BlockEnd end = compile_block(&c, prog, NULL);
+
+    destroyList(c.scratch);
+
+    if (end != BLOCK_EOF)
+    {
+        if (end != BLOCK_ERROR)
+            syntax_error(&c, "unexpected end of block");
+
+        release_program(prog);
+        return NULL;
+    }
+
+    return prog;
+}
+
+// Function appends text to the word being expanded
+static void append_text(char **word, int *size, int *length, char *text, int text_length)
+{
+    if (*length + text_length + 1 > *size)
+    {
+        while (*length + text_length + 1 > *size)
+        {
+            *size = *size == 0 ? SHELL_TOK_BUFSIZE : *size * 2;
+        }
+
+        *word = realloc(*word, *size);
+        if (!*word)
+        {
+            fprintf(stderr, "Shell Allocation Error\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    memcpy(*word + *length, text, text_length);
+    *length += text_length;
+}
+
+// Function expands the variables of a word and appends the result to a list
+// $NAME is an environment variable, $0-$9 and $# the positional args, $? the last exit status,
+// $$ the pid of the shell and a word that is only $@ becomes every positional arg
+static void expand_word(List *dst, char *token, Frame *frame)
+{
+    static char *word = NULL;
+    static int size = 0;
+    int length = 0;
+    char number[16];
+
+    if (strcmp(token, "$@") == 0)
+    {
+        for (int i = 1; i < frame->size; i++)
+        {
+            listAppendToken(dst, frame->args[i], 0, (int)strlen(frame->args[i]));
+        }
+
+        return;
+    }
+
+    for (int i = 0; token[i] != '\0'; i++)
+    {
+        char c = token[i + 1];
+
+        if (token[i] != '$' || c == '\0')
+        {
+            append_text(&word, &size, &length, token + i, 1);
+        }
+        else if (is_number(c))
+        {
+            int index = c - '0';
+
+            if (index < frame->size)
+                append_text(&word, &size, &length, frame->args[index], (int)strlen(frame->args[index]));
+            i++;
+        }
+        else if (c == '#')
+        {
+            append_text(&word, &size, &length, number, sprintf(number, "%d", frame->size > 0 ? frame->size - 1 : 0));
+            i++;
+        }
+        else if (c == '$')
+        {
+            append_text(&word, &size, &length, number, sprintf(number, "%d", getpid()));
+            i++;
+        }
+        else if (c == '?')
+        {
+            int code = WIFEXITED(LastStatus) ? WEXITSTATUS(LastStatus) : 128 + WTERMSIG(LastStatus);
+
+            append_text(&word, &size, &length, number, sprintf(number, "%d", code));
+            i++;
+        }
+        else if (is_letter(c) || c == '_')
+        {
+            int start = i + 1, end = i + 1;
+
+            while (is_letter(token[end]) || is_number(token[end]) || token[end] == '_')
+            {
+                end++;
+            }
+            // Look the name up without copying it
+            char saved = token[end];
+            token[end] = '\0';
+            char *value = getenv(token + start);
+            token[end] = saved;
+
+            if (value)
+                append_text(&word, &size, &length, value, (int)strlen(value));
+            i = end - 1;
+        }
+        else
+        {
+            append_text(&word, &size, &length, token + i, 1);
+        }
+    }
+
+    listAppendToken(dst, word == NULL ? "" : word, 0, length);
+}
+
+// Function expands the variables of every word of a command into dst
+// Commands without a $ are returned as they are
+List *expand_command(List *cmd, List *dst)
+{
+    if (memchr(cmd->buffer, '$', cmd->buffer_length) == NULL)
+        return cmd;
+
+    Frame *frame = &Frames[CallDepth];
+
+    listReset(dst);
+    for (int i = 0; i < cmd->count; i++)
+    {
+        for (int j = 0; j < cmd->container[i].size; j++)
+        {
+            expand_word(dst, cmd->container[i].line[j], frame);
+        }
+
+        listEndCommand(dst, cmd->container[i].ops);
+    }
+    listResolve(dst);
+
+    return dst;
+}
+
+// Function checks if a word is a NAME=value assignment
+static int is_assignment(char *word)
+{
+    if (!is_letter(word[0]) && word[0] != '_')
+        return 0;
+
+    for (int i = 1; word[i] != '\0'; i++)
+    {
+        if (word[i] == '=')
+            return 1;
+        if (!is_letter(word[i]) && !is_number(word[i]) && word[i] != '_')
+            return 0;
+    }
+
+    return 0;
+}
+
+// Function gets a scratch list of the current call depth, lists are kept for the next call at that depth
+static List *frame_list(List **list)
+{
+    if (*list == NULL)
+        *list = createList();
+
+    return *list;
+}
+
+// Function runs a function body with the args as its positional args
+static int call_function(Program *body, char **args, int size, struct Processes *proc)
+{
+    if (CallDepth + 1 >= SHELL_MAX_CALL_DEPTH)
+    {
+        fprintf(stderr, "%s: maximum function depth exceeded\n", args[0]);
+        LastStatus = W_EXITCODE(1, 0);
+        return 1;
+    }
+    // Keep the body alive even if it redefines itself
+    retain_program(body);
+    CallDepth++;
+    Frames[CallDepth].args = args;
+    Frames[CallDepth].size = size;
+
+    int status = run_program(body, proc);
+
+    CallDepth--;
+    release_program(body);
+
+    return status;
+}
+
+// Function runs a single command after expanding its aliases and variables
+// Assignments, functions, builtins and programs are checked in that order
+int run_command(List *cmd, struct Processes *proc)
+{
+    Frame *frame = &Frames[CallDepth];
+    List *args = expand_command(expand_aliases(cmd, frame_list(&frame->aliased)), frame_list(&frame->scratch));
+
+    if (listIsEmpty(args))
+        return 1;
+
+    char **line = args->container[0].line;
+    int size = args->container[0].size;
+    // NAME=value sets an environment variable
+    if (args->count == 1 && size == 1 && is_assignment(line[0]))
+    {
+        char *value = strchr(line[0], '=');
+
+        *value = '\0';
+        setenv(line[0], value + 1, 1);
+        *value = '=';
+        LastStatus = 0;
+        return 1;
+    }
+
+    Function *fn = find_function(line[0]);
+
+    if (fn != NULL)
+        return call_function(fn->body, line, size, proc);
+
+    return shell_execute(args, LastStatus, proc);
+}
+
+// Function runs the bytecode of a program, returns 0 if the shell should exit
+int run_program(Program *prog, struct Processes *proc)
+{
+    LoopState *loops = NULL; // State of each for loop, by command index
+    int status = 1;
+    int pc = 0;
+
+    if (prog->loops > 0)
+    {
+        loops = calloc(prog->command_count, sizeof(LoopState));
+
+        if (!loops)
+        {
+            fprintf(stderr, "Shell Allocation Error\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    while (status && pc < prog->count)
+    {
+        Instruction *in = &prog->code[pc++];
+
+        switch (in->op)
+        {
+        case OP_EXEC:
+            status = run_command(prog->commands[in->arg], proc);
+            break;
+        case OP_JUMP:
+            pc = in->target;
+            break;
+        case OP_JUMP_IF_FALSE:
+            if (LastStatus != 0)
+                pc = in->target;
+            break;
+        case OP_FOR_INIT:
+        {
+            LoopState *loop = &loops[in->arg];
+            // Expand the words once each time the loop is entered
+            if (loop->scratch == NULL)
+                loop->scratch = createList();
+            loop->words = expand_command(prog->commands[in->arg], loop->scratch);
+            loop->position = 2;
+            break;
+        }
+        case OP_FOR_NEXT:
+        {
+            LoopState *loop = &loops[in->arg];
+            // A jump straight here or a NAME that expanded to nothing ends the loop
+            if (loop->words == NULL || loop->words->count == 0 || loop->position >= loop->words->container[0].size)
+            {
+                pc = in->target;
+                break;
+            }
+
+            setenv(loop->words->container[0].line[0], loop->words->container[0].line[loop->position++], 1);
+            break;
+        }
+        case OP_DEFINE:
+            define_function(prog->bodies[in->arg]);
+            LastStatus = 0;
+            break;
+        case OP_RETURN:
+            if (in->arg != -1)
+                LastStatus = W_EXITCODE(in->arg, 0);
+            pc = prog->count;
+            break;
+        }
+    }
+
+    if (loops != NULL)
+    {
+        for (int i = 0; i < prog->command_count; i++)
+        {
+            destroyList(loops[i].scratch);
+        }
+
+        free(loops);
+    }
+
+    return status;
+}
+
+// Function hashes a name with 32 bit FNV-1a
+static unsigned int hash_name(char *name)
+{
+    unsigned int hash = 2166136261u;
+
+    for (; *name != '\0'; name++)
+    {
+        hash ^= (unsigned char)*name;
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+// Function finds the slot of a name, either its function or the empty slot it would go in
+static Function *function_slot(Function *table, int size, char *name)
+{
+    unsigned int i = hash_name(name) & (size - 1);
+
+    while (table[i].name != NULL && strcmp(table[i].name, name) != 0)
+    {
+        i = (i + 1) & (size - 1);
+    }
+
+    return &table[i];
+}
+
+// Function finds a function by name
+Function *find_function(char *name)
+{
+    if (Funcs.count == 0)
+        return NULL;
+
+    Function *fn = function_slot(Funcs.function, Funcs.size, name);
+
+    return fn->name != NULL ? fn : NULL;
+}
+
+// Function doubles the function table once it's three quarters full
+static void grow_functions(void)
+{
+    if (Funcs.function != NULL && (Funcs.count + 1) * 4 <= Funcs.size * 3)
+        return;
+
+    int size = Funcs.size == 0 ? SHELL_FUNCTIONS_SIZE : Funcs.size * 2;
+    Function *table = calloc(size, sizeof(Function));
+
+    if (!table)
+    {
+        fprintf(stderr, "Shell Allocation Error\n");
+        exit(EXIT_FAILURE);
+    }
+    // Move every function into the bigger table
+    for (int i = 0; i < Funcs.size; i++)
+    {
+        if (Funcs.function[i].name != NULL)
+            *function_slot(table, size, Funcs.function[i].name) = Funcs.function[i];
+    }
+
+    free(Funcs.function);
+    Funcs.function = table;
+    Funcs.size = size;
+}
+
+// Function defines a function, replacing one with the same name
+void define_function(Program *body)
+{
+    grow_functions();
+
+    Function *fn = function_slot(Funcs.function, Funcs.size, body->name);
+
+    retain_program(body);
+    if (fn->name != NULL)
+        release_program(fn->body);
+    else
+        Funcs.count++;
+
+    fn->name = body->name;
+    fn->body = body;
+}
+
+// Function frees every function and the scratch lists of the call frames
+void destroy_functions(void)
+{
+    for (int i = 0; i < Funcs.size; i++)
+    {
+        if (Funcs.function[i].name != NULL)
+            release_program(Funcs.function[i].body);
+    }
+
+    free(Funcs.function);
+    Funcs.function = NULL;
+    Funcs.size = 0;
+    Funcs.count = 0;
+
+    for (int i = 0; i < SHELL_MAX_CALL_DEPTH; i++)
+    {
+        destroyList(Frames[i].scratch);
+        destroyList(Frames[i].aliased);
+        Frames[i].scratch = NULL;
+        Frames[i].aliased = NULL;
+    }
+}
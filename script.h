@@ -0,0 +1,97 @@
+//
+//  script.h
+//  Shell
+//
+//  Control flow and functions compiled once into bytecode that is run directly.
+//
+
+#ifndef script_h
+#define script_h
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+
+#include "lexer.h"
+
+#define SHELL_MAX_CALL_DEPTH 256
+#define SHELL_FUNCTIONS_SIZE 64
+
+struct Processes;
+
+typedef enum
+{
+    OP_EXEC,          // Run command arg
+    OP_JUMP,          // Continue at target
+    OP_JUMP_IF_FALSE, // Continue at target if the last command failed
+    OP_FOR_INIT,      // Expand the words of for loop arg
+    OP_FOR_NEXT,      // Assign the next word of for loop arg or continue at target when done
+    OP_DEFINE,        // Define function body arg
+    OP_RETURN         // Leave the program, setting the status to arg unless it's -1
+} OpCode;
+
+typedef struct
+{
+    int op;
+    int arg;
+    int target;
+} Instruction;
+
+// A compiled script or function body, the commands are lexed once when it's compiled
+typedef struct Program
+{
+    char *name; // Name of the function, NULL for a script
+    Instruction *code;
+    int count;
+    int size;
+    List **commands;
+    int command_count;
+    int command_size;
+    struct Program **bodies; // Functions defined by this program
+    int body_count;
+    int body_size;
+    int loops; // Number of for loops, their words need space while running
+    int refs;
+} Program;
+
+typedef struct
+{
+    char *name;
+    Program *body;
+} Function;
+
+// Open addressed hash table of functions, empty slots have no name
+typedef struct
+{
+    Function *function;
+    int size; // Always a power of two
+    int count;
+} Functions;
+
+// Positional args of a running function and the list its commands are expanded into
+typedef struct
+{
+    char **args;
+    int size;
+    List *scratch;
+    List *aliased; // Commands after their aliases were spliced in
+} Frame;
+
+int script_block_depth(char *);
+Program *create_program(char *);
+void retain_program(Program *);
+void release_program(Program *);
+int program_add_command(Program *, List *);
+int program_add_body(Program *, Program *);
+int program_emit(Program *, int, int, int);
+Program *compile_script(char **, int);
+int run_program(Program *, struct Processes *);
+int run_command(List *, struct Processes *);
+List *expand_command(List *, List *);
+
+Function *find_function(char *);
+void define_function(Program *);
+void destroy_functions(void);
+
+#endif /* script_h */
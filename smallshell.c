@@ -9,12 +9,35 @@
 #include "smallshell.h"
 
 int ForegroundOnly = 0;
-char *builtin_str[] = {"cd", "status", "exit"};
+int LastStatus = 0; // Wait status of the last foreground command
+char *builtin_str[] = {"cd", "status", "exit", "ulimit", "coproc", "send", "alias", "unalias"};
 
 int (*builtin_func[])(char **, int, int) = {
     &shell_cd,
     &shell_status,
-    &shell_exit};
+    &shell_exit,
+    &shell_ulimit,
+    &shell_coproc,
+    &shell_send,
+    &shell_alias,
+    &shell_unalias};
+
+// Resources that can be changed with ulimit, sizes are reported in units of scale bytes
+struct
+{
+    char flag;
+    int resource;
+    rlim_t scale;
+    char *name;
+} ulimit_resources[] = {
+    {'c', RLIMIT_CORE, 1024, "core file size (kbytes)"},
+    {'d', RLIMIT_DATA, 1024, "data seg size (kbytes)"},
+    {'f', RLIMIT_FSIZE, 1024, "file size (kbytes)"},
+    {'n', RLIMIT_NOFILE, 1, "open files"},
+    {'s', RLIMIT_STACK, 1024, "stack size (kbytes)"},
+    {'t', RLIMIT_CPU, 1, "cpu time (seconds)"},
+    {'u', RLIMIT_NPROC, 1, "max user processes"},
+    {'v', RLIMIT_AS, 1024, "virtual memory (kbytes)"}};
 
 // Function gets the number of built in functions for the shell
 int shell_num_builtins()
@@ -28,7 +51,11 @@ int shell_cd(char **args, int size, int status)
     // Go to home directory if the args is empty
     if (args[1] == NULL)
     {
-        chdir(getenv("HOME"));
+        if (chdir(getenv("HOME")) != 0)
+        {
+            perror("Shell");
+            LastStatus = W_EXITCODE(1, 0);
+        }
     }
     else
     {
@@ -36,6 +63,7 @@ int shell_cd(char **args, int size, int status)
         if (chdir(args[1]) != 0)
         {
             perror("Shell");
+            LastStatus = W_EXITCODE(1, 0);
         }
     }
 
@@ -48,12 +76,12 @@ int shell_status(char **args, int size, int status)
     // Check for exit status
     if (WIFEXITED(status))
     {
-        printf("Shell: Last Foreground Process exited with an exit status of %d\n", status);
+        printf("Shell: Last Foreground Process exited with an exit status of %d\n", WEXITSTATUS(status));
     }
     // Check signal status
     else if (WIFSIGNALED(status))
     {
-        printf("Shell: Last Foreground Process was terminated by signal %d\n", status);
+        printf("Shell: Last Foreground Process was terminated by signal %d\n", WTERMSIG(status));
     }
 
     return 1;
@@ -65,31 +93,211 @@ int shell_exit(char **args, int size, int status)
     return 0;
 }
 
+// Function prints a single resource limit value
+void print_limit(rlim_t value, rlim_t scale)
+{
+    if (value == RLIM_INFINITY)
+    {
+        printf("unlimited\n");
+    }
+    else
+    {
+        printf("%llu\n", (unsigned long long)(value / scale));
+    }
+}
+
+// Function shows or changes the resource limits of the shell
+// Limits are inherited by every process the shell launches afterwards
+int shell_ulimit(char **args, int size, int status)
+{
+    int num_resources = sizeof(ulimit_resources) / sizeof(ulimit_resources[0]);
+    int soft = 0, hard = 0, all = 0, index = 2; // file size is the default resource
+    int i;
+    // Parse the flags
+    for (i = 1; i < size && args[i][0] == '-' && args[i][1] != '\0'; i++)
+    {
+        for (char *flag = args[i] + 1; *flag != '\0'; flag++)
+        {
+            int r;
+
+            if (*flag == 'S')
+                soft = 1;
+            else if (*flag == 'H')
+                hard = 1;
+            else if (*flag == 'a')
+                all = 1;
+            else
+            {
+                for (r = 0; r < num_resources; r++)
+                {
+                    if (ulimit_resources[r].flag == *flag)
+                        break;
+                }
+
+                if (r == num_resources)
+                {
+                    fprintf(stderr, "ulimit: invalid option -%c\n", *flag);
+                    LastStatus = W_EXITCODE(1, 0);
+                    return 1;
+                }
+
+                index = r;
+            }
+        }
+    }
+    // Show every limit
+    if (all)
+    {
+        for (int r = 0; r < num_resources; r++)
+        {
+            struct rlimit limit;
+
+            getrlimit(ulimit_resources[r].resource, &limit);
+            printf("%-28s(-%c) ", ulimit_resources[r].name, ulimit_resources[r].flag);
+            print_limit(hard && !soft ? limit.rlim_max : limit.rlim_cur, ulimit_resources[r].scale);
+        }
+
+        return 1;
+    }
+
+    struct rlimit limit;
+
+    if (getrlimit(ulimit_resources[index].resource, &limit) == -1)
+    {
+        perror("ulimit");
+        LastStatus = W_EXITCODE(1, 0);
+        return 1;
+    }
+    // Show a single limit
+    if (i >= size)
+    {
+        print_limit(hard && !soft ? limit.rlim_max : limit.rlim_cur, ulimit_resources[index].scale);
+        return 1;
+    }
+
+    rlim_t value;
+
+    if (!parse_size(args[i], &value))
+    {
+        fprintf(stderr, "ulimit: %s: invalid number\n", args[i]);
+        LastStatus = W_EXITCODE(1, 0);
+        return 1;
+    }
+
+    // Plain numbers are in the resource's units, a K, M or G suffix already gave bytes
+    size_t length = strlen(args[i]);
+
+    if (value != RLIM_INFINITY && isdigit((unsigned char)args[i][length - 1]))
+    {
+        if (value > (RLIM_INFINITY - 1) / ulimit_resources[index].scale)
+        {
+            fprintf(stderr, "ulimit: %s: value too large\n", args[i]);
+            LastStatus = W_EXITCODE(1, 0);
+            return 1;
+        }
+
+        value *= ulimit_resources[index].scale;
+    }
+    // Change both limits unless only one was asked for
+    if (soft || !hard)
+        limit.rlim_cur = value;
+    if (hard || !soft)
+        limit.rlim_max = value;
+
+    if (setrlimit(ulimit_resources[index].resource, &limit) == -1)
+    {
+        perror("ulimit");
+        LastStatus = W_EXITCODE(1, 0);
+    }
+
+    return 1;
+}
+
 // Function sets up a loop that runs until the user calls the exit command
 void shell_loop(void)
 {
     char *line;
-    List *args;
+    List *args = createList(); // Reused for every line so its buffers stay warm
     Processes *proc = create_processes(); // Data Structure to track background processes
-    int status = 0;
+    int status = load_rc(proc); // Run the startup file before the first prompt
 
-    do
+    while (status)
     {
         write(STDOUT_FILENO, ": ", 2);
-        line = shell_read_line();      // get input
-        args = shell_split_line(line); // Parse input
-
-        status = shell_execute(args, status, proc); // Execute the args
+        line = shell_read_line(); // get input
+        // Control flow is read until its block is closed then compiled and run
+        if (script_block_depth(line) > 0)
+        {
+            status = shell_run_block(line, proc);
+        }
+        else
+        {
+            shell_split_line(args, line);     // Parse input
+            status = run_command(args, proc); // Execute the args
+        }
 
         check_background_process(proc); // Check for background processes
         // Free memory
         free(line);
-        destroyList(args);
         line = NULL;
-        args = NULL;
-    } while (status);
+    }
 
+    destroyList(args);
     destroy_proccess(proc);
+    destroy_pools();
+    destroy_functions();
+    destroy_aliases();
+}
+
+// Function reads the rest of a block that starts with line, then compiles and runs it
+int shell_run_block(char *line, Processes *proc)
+{
+    int size = 16, count = 0;
+    int depth = 0;
+    char **lines = malloc(sizeof(char *) * size);
+
+    if (!lines)
+    {
+        fprintf(stderr, "Shell Allocation Error\n");
+        exit(EXIT_FAILURE);
+    }
+    // Keep reading until every block has been closed
+    lines[count++] = strdup(line);
+    depth += script_block_depth(line);
+    while (depth > 0 && !feof(stdin))
+    {
+        write(STDOUT_FILENO, "> ", 2);
+        lines[count] = shell_read_line();
+        depth += script_block_depth(lines[count++]);
+
+        if (count == size)
+        {
+            size *= 2;
+            lines = realloc(lines, sizeof(char *) * size);
+            if (!lines)
+            {
+                fprintf(stderr, "Shell Allocation Error\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+    }
+
+    int status = 1;
+    Program *prog = compile_script(lines, count);
+
+    if (prog != NULL)
+    {
+        status = run_program(prog, proc);
+        release_program(prog);
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        free(lines[i]);
+    }
+    free(lines);
+
+    return status;
 }
 
 // Function reads user input from stdin
@@ -131,15 +339,13 @@ char *shell_read_line(void)
 }
 
 // Function calls the parse input function to get the args list
-List *shell_split_line(char *line)
+List *shell_split_line(List *tokens, char *line)
 {
-    List *tokens = parse_input(line);
-
-    return tokens;
+    return parse_input_into(tokens, line);
 }
 
 // Function launches programs that are not implemented by the shell
-int shell_launch(List *args, Processes *proc)
+int shell_launch(List *args, Processes *proc, LaunchOptions *opts)
 {
     pid_t pid;
     int status;
@@ -165,19 +371,21 @@ int shell_launch(List *args, Processes *proc)
     // Check if there's any redirection or background processes
     for (int i = 0; i < args->count; i++)
     {
-        if (args->container[i]->ops == '<' && i + 1 < args->count)
+        if (args->container[i].ops == '<' && i + 1 < args->count)
         { // Input
-            pipes[0] = args->container[i + 1];
+            pipes[0] = &args->container[i + 1];
         }
-        else if (args->container[i]->ops == '>' && i + 1 < args->count)
+        else if (args->container[i].ops == '>' && i + 1 < args->count)
         { // Output
-            pipes[1] = args->container[i + 1];
+            pipes[1] = &args->container[i + 1];
         }
-        else if (args->container[i]->ops == '&' && !ForegroundOnly)
+        else if (args->container[i].ops == '&' && !ForegroundOnly)
         {
             background = 1;
         }
     }
+    // Flush so the child doesn't inherit and repeat buffered output
+    fflush(stdout);
     // Fork to create a new prcoess
     pid = fork();
     if (pid == 0)
@@ -239,10 +447,17 @@ int shell_launch(List *args, Processes *proc)
             // Change output from STDOUT to null
             dup2(output, 1);
         }
+        // Apply the limits, affinity, priority and cgroup requested through run
+        if (!apply_launch_options(opts))
+        {
+            exit(1);
+        }
+        // Skip past the run builtin and its options
+        char **command = nodeOne->line + opts->command;
         // Kill this process code and have the program run with this process id
-        if (execvp(nodeOne->line[0], nodeOne->line) == -1)
+        if (execvp(command[0], command) == -1)
         {
-            printf("%s: no such file or directory", nodeOne->line[0]);
+            printf("%s: no such file or directory", command[0]);
         }
         // If code reaches here there was a problem
         exit(EXIT_FAILURE);
@@ -250,6 +465,7 @@ int shell_launch(List *args, Processes *proc)
     else if (pid < 0)
     { // Error in fork process
         perror("Shell: Error starting child process through fork");
+        LastStatus = W_EXITCODE(1, 0);
     }
     else
     { // Parent process
@@ -257,12 +473,15 @@ int shell_launch(List *args, Processes *proc)
         {                           // If there was a background process
             add_process(proc, pid); // Add the process to the background list
             printf("Background PID is %d\n", pid);
+            LastStatus = 0;
             return 1; // Exit early to avoid waiting
         }
         do
         { // Wait for the child process to terminate
             waitpid(pid, &status, WUNTRACED);
         } while (!WIFEXITED(status) && !WIFSIGNALED(status));
+
+        LastStatus = status;
     }
 
     return 1;
@@ -272,22 +491,37 @@ int shell_launch(List *args, Processes *proc)
 // before calling the fork process to call external programs
 int shell_execute(List *args, int status, Processes *proc)
 {
+    LaunchOptions opts;
     // Check if there are rgs
-    if (args == NULL)
+    if (args == NULL || listIsEmpty(args))
     {
         return 1; // Empty command
     }
+
+    init_launch_options(&opts);
+    // The run builtin launches a program with resource options applied
+    if (strcmp(args->container[0].line[0], "run") == 0)
+    {
+        if (!parse_launch_options(args->container[0].line, args->container[0].size, &opts))
+        {
+            LastStatus = W_EXITCODE(1, 0);
+            return 1;
+        }
+
+        return shell_launch(args, proc, &opts);
+    }
     // Search the built-in list for the program
     for (int i = 0; i < shell_num_builtins(); i++)
     {
-        if (strcmp(args->container[0]->line[0], builtin_str[i]) == 0)
+        if (strcmp(args->container[0].line[0], builtin_str[i]) == 0)
         {
-            // Call the function if it is found
-            return (*builtin_func[i])(args->container[0]->line, args->container[0]->size, status);
+            // Call the function if it is found, builtins set LastStatus on their error paths
+            LastStatus = 0;
+            return (*builtin_func[i])(args->container[0].line, args->container[0].size, status);
         }
     }
     // Call the fork function
-    return shell_launch(args, proc);
+    return shell_launch(args, proc, &opts);
 }
 
 // Function checks the list of background prcoesses for any processes that have exited
@@ -304,6 +538,7 @@ void check_background_process(Processes *proc)
         {
             // remove pid if exited
             remove_process(proc, pid);
+            i--; // The next pid moved into this slot
             printf("Background PID: %d is done: exit value %d\n", pid, status);
         }
         // Check for signal terminate
@@ -311,6 +546,7 @@ void check_background_process(Processes *proc)
         {
             // remove process if terminated
             remove_process(proc, pid);
+            i--; // The next pid moved into this slot
             printf("Background PID: %d is done: terminated by signal %d\n", pid, status);
         }
     }
@@ -329,7 +565,7 @@ void sigint_handler(int sn)
 
     str[len - 1] = '\0'; // Make sure the last character is a null terminator
 
-    write(STDOUT_FILENO, str, count);
+    write(STDOUT_FILENO, str, strlen(str));
     fflush(stdout);
 }
 
@@ -387,6 +623,9 @@ void remove_process(Processes *p, pid_t pid)
             break;
         }
     }
+    // Nothing to remove
+    if (index == -1)
+        return;
 
     for (int i = index + 1; i < p->count; i++)
     {
@@ -20,12 +20,20 @@
 #include <sys/types.h>
 
 #include "lexer.h"
+#include "launch.h"
+#include "coproc.h"
+#include "script.h"
+#include "rc.h"
+#include "alias.h"
 
 #define SHELL_RL_BUFSIZE 1024
 #define SHELL_TOK_BUFSIZE 64
 #define SHELL_TOK_DELIM " \t\r\n\a\""
 
-typedef struct
+extern int ForegroundOnly;
+extern int LastStatus; // Wait status of the last foreground command, builtins set it on failure
+
+typedef struct Processes
 {
     pid_t *process;
     int size;
@@ -35,11 +43,13 @@ typedef struct
 int shell_cd(char **, int, int);
 int shell_status(char **, int, int);
 int shell_exit(char **, int, int);
+int shell_ulimit(char **, int, int);
 
 void shell_loop(void);
+int shell_run_block(char *, Processes *);
 char *shell_read_line(void);
-List *shell_split_line(char *);
-int shell_launch(List *, Processes *);
+List *shell_split_line(List *, char *);
+int shell_launch(List *, Processes *, LaunchOptions *);
 int shell_execute(List *, int, Processes *);
 
 void sigint_handler(int);